@@ -21,6 +21,7 @@
 static enum shutdown_type how = SHUTDOWN_NONE;
 
 static void print_stats(void);
+static void power_off(void) NO_RETURN;
 
 /*! Shuts down the machine in the way configured by shutdown_configure().
     If the shutdown type is SHUTDOWN_NONE (which is the default), returns
@@ -75,12 +76,23 @@ void shutdown_reboot(void) {
 /*! Powers down the machine we're running on,
     as long as we're running on Bochs or QEMU. */
 void shutdown_power_off(void) {
-    const char s[] = "Shutdown";
-    const char *p;
-
 #ifdef FILESYS
     filesys_done();
 #endif
+    power_off();
+}
+
+/*! Powers down the machine without writing back anything the file system
+    has cached, as if the power had failed.  Used to test recovery. */
+void shutdown_crash(void) {
+    printf("Crashing...\n");
+    power_off();
+}
+
+/*! Powers down the machine, as long as we're running on Bochs or QEMU. */
+static void power_off(void) {
+    const char s[] = "Shutdown";
+    const char *p;
 
     print_stats();
 
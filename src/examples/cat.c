@@ -20,13 +20,13 @@ main (int argc, char *argv[])
           success = false;
           continue;
         }
+      unsigned ofs = 0;
       for (;;) 
         {
-          char buffer[1024];
-          int bytes_read = read (fd, buffer, sizeof buffer);
-          if (bytes_read == 0)
+          int bytes_sent = sendfile (STDOUT_FILENO, fd, ofs, 4096);
+          if (bytes_sent <= 0)
             break;
-          write (STDOUT_FILENO, buffer, bytes_read);
+          ofs += bytes_sent;
         }
       close (fd);
     }
@@ -0,0 +1,261 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+
+/*! Number of sectors held by the buffer cache. */
+#define CACHE_SIZE 64
+
+/*! Sector number of a cache block that holds no sector. */
+#define CACHE_NO_SECTOR ((block_sector_t) -1)
+
+/*! A cached file system sector.
+
+    Dirty blocks are written back only when they are evicted or the cache is
+    flushed, so successive small writes to the same sector are coalesced into
+    a single disk write. */
+struct cache_block {
+    block_sector_t sector;              /*!< Cached sector, or CACHE_NO_SECTOR. */
+    bool valid;                         /*!< DATA holds SECTOR's contents. */
+    bool dirty;                         /*!< DATA differs from the disk. */
+    bool accessed;                      /*!< Used since the clock hand passed. */
+    int users;                          /*!< Threads using or waiting on it. */
+    int holds;                          /*!< While nonzero, never written. */
+    struct lock lock;                   /*!< Protects DATA, VALID and DIRTY. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /*!< Sector contents. */
+};
+
+static struct cache_block cache[CACHE_SIZE];
+
+/*! Protects the SECTOR, ACCESSED, USERS and HOLDS members of every block,
+    and the clock hand.  Never held while waiting for a block's lock. */
+static struct lock cache_lock;
+
+/*! Signaled when a block's USERS drops to zero. */
+static struct condition cache_unused;
+
+/*! Next block considered for eviction. */
+static size_t clock_hand;
+
+/*! Initializes the buffer cache. */
+void cache_init(void) {
+    size_t i;
+
+    lock_init(&cache_lock);
+    cond_init(&cache_unused);
+    for (i = 0; i < CACHE_SIZE; i++) {
+        cache[i].sector = CACHE_NO_SECTOR;
+        cache[i].valid = false;
+        cache[i].dirty = false;
+        cache[i].accessed = false;
+        cache[i].users = 0;
+        cache[i].holds = 0;
+        lock_init(&cache[i].lock);
+    }
+    clock_hand = 0;
+}
+
+/*! Picks a block that nobody is using or holding, writes it back if needed,
+    and returns it.  Waits for a block to become unused if necessary.  The
+    caller must hold `cache_lock'. */
+static struct cache_block * evict(void) {
+    for (;;) {
+        size_t i;
+        bool any_unused = false;
+
+        /* Two sweeps give every unused block a chance to lose its
+           accessed bit. */
+        for (i = 0; i < 2 * CACHE_SIZE; i++) {
+            struct cache_block *b = &cache[clock_hand];
+            clock_hand = (clock_hand + 1) % CACHE_SIZE;
+            if (b->users > 0 || b->holds > 0)
+                continue;
+            any_unused = true;
+            if (b->accessed) {
+                b->accessed = false;
+                continue;
+            }
+            if (b->dirty) {
+                /* Nobody else can touch B while its USERS is zero and we
+                   hold `cache_lock'. */
+                block_write(fs_device, b->sector, b->data);
+                b->dirty = false;
+            }
+            return b;
+        }
+        if (!any_unused)
+            cond_wait(&cache_unused, &cache_lock);
+    }
+}
+
+/*! Returns the block holding SECTOR, or a null pointer if SECTOR is not
+    cached.  The caller must hold `cache_lock'. */
+static struct cache_block * cache_find(block_sector_t sector) {
+    size_t i;
+
+    for (i = 0; i < CACHE_SIZE; i++) {
+        if (cache[i].sector == sector)
+            return &cache[i];
+    }
+    return NULL;
+}
+
+/*! Returns the cache block for SECTOR, with its lock held.  If READ is true,
+    the block's data is valid on return; otherwise the caller is about to
+    overwrite all of it and the disk is not read. */
+static struct cache_block * cache_get(block_sector_t sector, bool read) {
+    struct cache_block *b;
+
+    ASSERT(sector != CACHE_NO_SECTOR);
+
+    lock_acquire(&cache_lock);
+    b = cache_find(sector);
+    if (b == NULL) {
+        b = evict();
+        b->sector = sector;
+        b->valid = false;
+    }
+    b->users++;
+    b->accessed = true;
+    lock_release(&cache_lock);
+
+    lock_acquire(&b->lock);
+    if (read && !b->valid) {
+        block_read(fs_device, sector, b->data);
+        b->valid = true;
+    }
+    return b;
+}
+
+/*! Releases block B obtained from cache_get(). */
+static void cache_put(struct cache_block *b) {
+    lock_release(&b->lock);
+    lock_acquire(&cache_lock);
+    if (--b->users == 0 && b->holds == 0)
+        cond_signal(&cache_unused, &cache_lock);
+    lock_release(&cache_lock);
+}
+
+/*! Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER. */
+void cache_read_at(block_sector_t sector, void *buffer, size_t ofs,
+                   size_t size) {
+    struct cache_block *b;
+
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+    b = cache_get(sector, true);
+    memcpy(buffer, b->data + ofs, size);
+    cache_put(b);
+}
+
+/*! Passes the SIZE bytes starting at byte OFS of SECTOR to FUNC, along with
+    AUX, straight out of the cache block instead of copying them.  The block
+    stays locked while FUNC runs, so FUNC must not use the cache itself. */
+void cache_read_with(block_sector_t sector, size_t ofs, size_t size,
+                     cache_read_func *func, void *aux) {
+    struct cache_block *b;
+
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+    b = cache_get(sector, true);
+    func(b->data + ofs, size, aux);
+    cache_put(b);
+}
+
+/*! Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS.  The
+    sector is only read from disk first if the write does not cover all of
+    it, and is written back later. */
+void cache_write_at(block_sector_t sector, const void *buffer, size_t ofs,
+                    size_t size) {
+    struct cache_block *b;
+    bool whole = ofs == 0 && size == BLOCK_SECTOR_SIZE;
+
+    ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+    b = cache_get(sector, !whole);
+    memcpy(b->data + ofs, buffer, size);
+    b->valid = true;
+    b->dirty = true;
+    cache_put(b);
+}
+
+/*! Sets SECTOR to all zeros without reading it from disk. */
+void cache_zero(block_sector_t sector) {
+    struct cache_block *b = cache_get(sector, false);
+    memset(b->data, 0, BLOCK_SECTOR_SIZE);
+    b->valid = true;
+    b->dirty = true;
+    cache_put(b);
+}
+
+/*! Keeps SECTOR in the cache and stops it from being written back, until a
+    matching cache_unhold().  Used by the journal to keep metadata that has
+    not been committed yet off its home location. */
+void cache_hold(block_sector_t sector) {
+    struct cache_block *b = cache_get(sector, false);
+
+    lock_acquire(&cache_lock);
+    b->holds++;
+    lock_release(&cache_lock);
+    cache_put(b);
+}
+
+/*! Releases a hold placed on SECTOR by cache_hold().  The block stays dirty
+    and is written back whenever it is evicted or flushed. */
+void cache_unhold(block_sector_t sector) {
+    struct cache_block *b;
+
+    lock_acquire(&cache_lock);
+    b = cache_find(sector);
+    ASSERT(b != NULL && b->holds > 0);
+    if (--b->holds == 0 && b->users == 0)
+        cond_signal(&cache_unused, &cache_lock);
+    lock_release(&cache_lock);
+}
+
+/*! Writes SECTOR back to disk now if it is cached and dirty, even if it is
+    held. */
+void cache_flush_sector(block_sector_t sector) {
+    struct cache_block *b;
+
+    lock_acquire(&cache_lock);
+    b = cache_find(sector);
+    if (b == NULL) {
+        lock_release(&cache_lock);
+        return;
+    }
+    b->users++;
+    lock_release(&cache_lock);
+
+    lock_acquire(&b->lock);
+    if (b->dirty) {
+        block_write(fs_device, b->sector, b->data);
+        b->dirty = false;
+    }
+    cache_put(b);
+}
+
+/*! Writes every dirty block that is not held back to disk. */
+void cache_flush(void) {
+    size_t i;
+
+    for (i = 0; i < CACHE_SIZE; i++) {
+        struct cache_block *b = &cache[i];
+
+        /* Count ourselves as a user so that B cannot be evicted and
+           reassigned while we write it. */
+        lock_acquire(&cache_lock);
+        if (b->sector == CACHE_NO_SECTOR || b->holds > 0) {
+            lock_release(&cache_lock);
+            continue;
+        }
+        b->users++;
+        lock_release(&cache_lock);
+
+        lock_acquire(&b->lock);
+        if (b->dirty) {
+            block_write(fs_device, b->sector, b->data);
+            b->dirty = false;
+        }
+        cache_put(b);
+    }
+}
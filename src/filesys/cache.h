@@ -0,0 +1,21 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/*! Receives SIZE bytes of cached data at DATA, for cache_read_with(). */
+typedef void cache_read_func(const void *data, size_t size, void *aux);
+
+void cache_init(void);
+void cache_read_at(block_sector_t, void *, size_t ofs, size_t size);
+void cache_read_with(block_sector_t, size_t ofs, size_t size,
+                     cache_read_func *, void *aux);
+void cache_write_at(block_sector_t, const void *, size_t ofs, size_t size);
+void cache_zero(block_sector_t);
+void cache_hold(block_sector_t);
+void cache_unhold(block_sector_t);
+void cache_flush_sector(block_sector_t);
+void cache_flush(void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,183 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/*! Maximum number of cached names.  Once full, the least recently used
+    entry is recycled. */
+#define DCACHE_SIZE 64
+
+/*! A cached (parent directory, name) -> inode sector translation. */
+struct dcache_entry {
+    struct hash_elem hash_elem;         /*!< Element in `dcache'. */
+    struct list_elem lru_elem;          /*!< Element in `dcache_lru'. */
+    block_sector_t parent;              /*!< Inode sector of the directory. */
+    char name[NAME_MAX + 1];            /*!< Null terminated file name. */
+    bool negative;                      /*!< True if NAME is absent. */
+    block_sector_t inode_sector;        /*!< Sector of NAME's inode. */
+};
+
+/*! Cached entries, keyed by parent sector and name. */
+static struct hash dcache;
+
+/*! All cached entries, most recently used at the front. */
+static struct list dcache_lru;
+
+/*! Protects `dcache' and `dcache_lru'. */
+static struct lock dcache_lock;
+
+static unsigned dcache_entry_hash(const struct hash_elem *e_, void *aux UNUSED) {
+    const struct dcache_entry *e =
+        hash_entry(e_, struct dcache_entry, hash_elem);
+    return hash_int(e->parent) ^ hash_string(e->name);
+}
+
+static bool dcache_entry_less(const struct hash_elem *a_,
+                              const struct hash_elem *b_, void *aux UNUSED) {
+    const struct dcache_entry *a =
+        hash_entry(a_, struct dcache_entry, hash_elem);
+    const struct dcache_entry *b =
+        hash_entry(b_, struct dcache_entry, hash_elem);
+    if (a->parent != b->parent)
+        return a->parent < b->parent;
+    return strcmp(a->name, b->name) < 0;
+}
+
+/*! Initializes the directory-entry cache. */
+void dcache_init(void) {
+    hash_init(&dcache, dcache_entry_hash, dcache_entry_less, NULL);
+    list_init(&dcache_lru);
+    lock_init(&dcache_lock);
+}
+
+/*! Returns the entry for NAME in PARENT, or a null pointer if there is none.
+    NAME must fit in a directory entry.  The caller must hold `dcache_lock'. */
+static struct dcache_entry * find(block_sector_t parent, const char *name) {
+    struct dcache_entry key;
+    struct hash_elem *e;
+
+    ASSERT(lock_held_by_current_thread(&dcache_lock));
+    key.parent = parent;
+    strlcpy(key.name, name, sizeof key.name);
+    e = hash_find(&dcache, &key.hash_elem);
+    return e != NULL ? hash_entry(e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/*! Removes E from the cache and frees it.  The caller must hold
+    `dcache_lock'. */
+static void evict(struct dcache_entry *e) {
+    hash_delete(&dcache, &e->hash_elem);
+    list_remove(&e->lru_elem);
+    free(e);
+}
+
+/*! Records that NAME in PARENT is at INODE_SECTOR, or is absent if NEGATIVE
+    is true, replacing anything previously cached for that name. */
+static void insert(block_sector_t parent, const char *name, bool negative,
+                   block_sector_t inode_sector) {
+    struct dcache_entry *e;
+
+    if (strlen(name) > NAME_MAX)
+        return;
+
+    lock_acquire(&dcache_lock);
+    e = find(parent, name);
+    if (e == NULL) {
+        if (hash_size(&dcache) >= DCACHE_SIZE) {
+            /* Recycle the least recently used entry. */
+            e = list_entry(list_back(&dcache_lru), struct dcache_entry,
+                           lru_elem);
+            hash_delete(&dcache, &e->hash_elem);
+            list_remove(&e->lru_elem);
+        }
+        else {
+            e = malloc(sizeof *e);
+            if (e == NULL) {
+                lock_release(&dcache_lock);
+                return;
+            }
+        }
+        e->parent = parent;
+        strlcpy(e->name, name, sizeof e->name);
+        hash_insert(&dcache, &e->hash_elem);
+    }
+    else {
+        list_remove(&e->lru_elem);
+    }
+    e->negative = negative;
+    e->inode_sector = inode_sector;
+    list_push_front(&dcache_lru, &e->lru_elem);
+    lock_release(&dcache_lock);
+}
+
+/*! Looks up NAME in the directory whose inode is at PARENT.  On DCACHE_HIT,
+    stores the sector of NAME's inode in *INODE_SECTOR. */
+enum dcache_result dcache_lookup(block_sector_t parent, const char *name,
+                                 block_sector_t *inode_sector) {
+    enum dcache_result result = DCACHE_MISS;
+    struct dcache_entry *e;
+
+    if (strlen(name) > NAME_MAX)
+        return DCACHE_MISS;
+
+    lock_acquire(&dcache_lock);
+    e = find(parent, name);
+    if (e != NULL) {
+        list_remove(&e->lru_elem);
+        list_push_front(&dcache_lru, &e->lru_elem);
+        if (e->negative) {
+            result = DCACHE_NEGATIVE;
+        }
+        else {
+            *inode_sector = e->inode_sector;
+            result = DCACHE_HIT;
+        }
+    }
+    lock_release(&dcache_lock);
+    return result;
+}
+
+/*! Records that NAME in PARENT has its inode at INODE_SECTOR. */
+void dcache_insert(block_sector_t parent, const char *name,
+                   block_sector_t inode_sector) {
+    insert(parent, name, false, inode_sector);
+}
+
+/*! Records that PARENT contains no entry named NAME. */
+void dcache_insert_negative(block_sector_t parent, const char *name) {
+    insert(parent, name, true, 0);
+}
+
+/*! Forgets anything cached about NAME in PARENT. */
+void dcache_invalidate(block_sector_t parent, const char *name) {
+    struct dcache_entry *e;
+
+    if (strlen(name) > NAME_MAX)
+        return;
+
+    lock_acquire(&dcache_lock);
+    e = find(parent, name);
+    if (e != NULL)
+        evict(e);
+    lock_release(&dcache_lock);
+}
+
+/*! Forgets every name cached for the directory at PARENT.  Used when a
+    directory inode is (re)created, since its sector may previously have
+    held a different directory. */
+void dcache_invalidate_dir(block_sector_t parent) {
+    struct list_elem *e, *next;
+
+    lock_acquire(&dcache_lock);
+    for (e = list_begin(&dcache_lru); e != list_end(&dcache_lru); e = next) {
+        struct dcache_entry *de = list_entry(e, struct dcache_entry, lru_elem);
+        next = list_next(e);
+        if (de->parent == parent)
+            evict(de);
+    }
+    lock_release(&dcache_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/*! Outcome of a directory-entry cache lookup. */
+enum dcache_result {
+    DCACHE_MISS,                /*!< Nothing known; scan the directory. */
+    DCACHE_HIT,                 /*!< Name exists at the returned sector. */
+    DCACHE_NEGATIVE             /*!< Name is known not to exist. */
+};
+
+void dcache_init(void);
+enum dcache_result dcache_lookup(block_sector_t parent, const char *name,
+                                 block_sector_t *inode_sector);
+void dcache_insert(block_sector_t parent, const char *name,
+                   block_sector_t inode_sector);
+void dcache_insert_negative(block_sector_t parent, const char *name);
+void dcache_invalidate(block_sector_t parent, const char *name);
+void dcache_invalidate_dir(block_sector_t parent);
+
+#endif /* filesys/dcache.h */
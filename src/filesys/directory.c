@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -22,7 +23,8 @@ struct dir_entry {
 /*! Creates a directory with space for ENTRY_CNT entries in the
     given SECTOR.  Returns true if successful, false on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt) {
-    return inode_create(sector, entry_cnt * sizeof(struct dir_entry));
+    dcache_invalidate_dir(sector);
+    return inode_create(sector, entry_cnt * sizeof(struct dir_entry), true);
 }
 
 /*! Opens and returns the directory for the given INODE, of which
@@ -94,17 +96,40 @@ static bool lookup(const struct dir *dir, const char *name,
 
 /*! Searches DIR for a file with the given NAME and returns true if one exists,
     false otherwise.  On success, sets *INODE to an inode for the file,
-    otherwise to a null pointer.  The caller must close *INODE. */
+    otherwise to a null pointer.  The caller must close *INODE.
+    Answers from the directory-entry cache when possible, so that repeated
+    lookups of the same name do not rescan the directory. */
 bool dir_lookup(const struct dir *dir, const char *name, struct inode **inode) {
+    block_sector_t parent, inode_sector;
     struct dir_entry e;
 
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
-    if (lookup(dir, name, &e, NULL))
-        *inode = inode_open(e.inode_sector);
-    else
+    parent = inode_get_inumber(dir->inode);
+    inode_dir_lock_acquire(dir->inode);
+    switch (dcache_lookup(parent, name, &inode_sector)) {
+    case DCACHE_HIT:
+        *inode = inode_open(inode_sector);
+        break;
+
+    case DCACHE_NEGATIVE:
         *inode = NULL;
+        break;
+
+    case DCACHE_MISS:
+    default:
+        if (lookup(dir, name, &e, NULL)) {
+            dcache_insert(parent, name, e.inode_sector);
+            *inode = inode_open(e.inode_sector);
+        }
+        else {
+            dcache_insert_negative(parent, name);
+            *inode = NULL;
+        }
+        break;
+    }
+    inode_dir_lock_release(dir->inode);
 
     return *inode != NULL;
 }
@@ -126,6 +151,8 @@ bool dir_add(struct dir *dir, const char *name, block_sector_t inode_sector) {
     if (*name == '\0' || strlen(name) > NAME_MAX)
         return false;
 
+    inode_dir_lock_acquire(dir->inode);
+
     /* Check that NAME is not in use. */
     if (lookup(dir, name, NULL, NULL))
         goto done;
@@ -148,8 +175,13 @@ bool dir_add(struct dir *dir, const char *name, block_sector_t inode_sector) {
     strlcpy(e.name, name, sizeof e.name);
     e.inode_sector = inode_sector;
     success = inode_write_at(dir->inode, &e, sizeof(e), ofs) == sizeof(e);
+    if (success)
+        dcache_insert(inode_get_inumber(dir->inode), name, inode_sector);
+    else
+        dcache_invalidate(inode_get_inumber(dir->inode), name);
 
 done:
+    inode_dir_lock_release(dir->inode);
     return success;
 }
 
@@ -164,6 +196,8 @@ bool dir_remove(struct dir *dir, const char *name) {
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
+    inode_dir_lock_acquire(dir->inode);
+
     /* Find directory entry. */
     if (!lookup(dir, name, &e, &ofs))
         goto done;
@@ -175,14 +209,18 @@ bool dir_remove(struct dir *dir, const char *name) {
 
     /* Erase directory entry. */
     e.in_use = false;
-    if (inode_write_at(dir->inode, &e, sizeof(e), ofs) != sizeof(e))
+    if (inode_write_at(dir->inode, &e, sizeof(e), ofs) != sizeof(e)) {
+        dcache_invalidate(inode_get_inumber(dir->inode), name);
         goto done;
+    }
+    dcache_insert_negative(inode_get_inumber(dir->inode), name);
 
     /* Remove inode. */
     inode_remove(inode);
     success = true;
 
 done:
+    inode_dir_lock_release(dir->inode);
     inode_close(inode);
     return success;
 }
@@ -191,14 +229,18 @@ done:
     true if successful, false if the directory contains no more entries. */
 bool dir_readdir(struct dir *dir, char name[NAME_MAX + 1]) {
     struct dir_entry e;
+    bool found = false;
 
+    inode_dir_lock_acquire(dir->inode);
     while (inode_read_at(dir->inode, &e, sizeof(e), dir->pos) == sizeof(e)) {
         dir->pos += sizeof(e);
         if (e.in_use) {
             strlcpy(name, e.name, NAME_MAX + 1);
-            return true;
+            found = true;
+            break;
         } 
     }
-    return false;
+    inode_dir_lock_release(dir->inode);
+    return found;
 }
 
@@ -1,6 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 
 /*! An open file. */
@@ -8,6 +9,7 @@ struct file {
     struct inode *inode;        /*!< File's inode. */
     off_t pos;                  /*!< Current position. */
     bool deny_write;            /*!< Has file_deny_write() been called? */
+    int ref_cnt;                /*!< Number of holders; see file_dup(). */
 };
 
 /*! Opens a file for the given INODE, of which it takes ownership,
@@ -19,6 +21,7 @@ struct file * file_open(struct inode *inode) {
         file->inode = inode;
         file->pos = 0;
         file->deny_write = false;
+        file->ref_cnt = 1;
         return file;
     }
     else {
@@ -34,9 +37,23 @@ struct file * file_reopen(struct file *file) {
     return file_open(inode_reopen(file->inode));
 }
 
-/*! Closes FILE. */
+/*! Returns FILE itself, with one more holder.  Unlike file_reopen(), the
+    holders share a position.  Each must call file_close(). */
+struct file * file_dup(struct file *file) {
+    enum intr_level old_level = intr_disable();
+    file->ref_cnt++;
+    intr_set_level(old_level);
+    return file;
+}
+
+/*! Closes FILE, once its last holder has closed it. */
 void file_close(struct file *file) {
     if (file != NULL) {
+        enum intr_level old_level = intr_disable();
+        bool last = --file->ref_cnt == 0;
+        intr_set_level(old_level);
+        if (!last)
+            return;
         file_allow_write(file);
         inode_close(file->inode);
         free(file); 
@@ -67,10 +84,18 @@ off_t file_read_at(struct file *file, void *buffer, off_t size,
     return inode_read_at(file->inode, buffer, size, file_ofs);
 }
 
+/*! Passes SIZE bytes of FILE, starting at offset FILE_OFS, to FUNC straight
+    from the buffer cache, as inode_read_with() does.  Returns the number of
+    bytes passed, which may be less than SIZE if end of file is reached.  The
+    file's current position is unaffected. */
+off_t file_read_with(struct file *file, off_t size, off_t file_ofs,
+                     cache_read_func *func, void *aux) {
+    return inode_read_with(file->inode, size, file_ofs, func, aux);
+}
+
 /*! Writes SIZE bytes from BUFFER into FILE, starting at the file's current
     position.  Returns the number of bytes actually written, which may be less
-    than SIZE if end of file is reached.  (Normally we'd grow the file in that
-    case, but file growth is not yet implemented.)
+    than SIZE if the disk fills up.  Writing past end of file grows the file.
     Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file *file, const void *buffer, off_t size) {
     off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
@@ -80,8 +105,7 @@ off_t file_write(struct file *file, const void *buffer, off_t size) {
 
 /*! Writes SIZE bytes from BUFFER into FILE, starting at offset FILE_OFS in
     the file.  Returns the number of bytes actually written, which may be less
-    than SIZE if end of file is reached.  (Normally we'd grow the file in that
-    case, but file growth is not yet implemented.)
+    than SIZE if the disk fills up.  Writing past end of file grows the file.
     The file's current position is unaffected. */
 off_t file_write_at(struct file *file, const void *buffer, off_t size,
                     off_t file_ofs) {
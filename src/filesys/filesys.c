@@ -2,9 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 
 /*! Partition that contains the file system. */
@@ -19,32 +22,50 @@ void filesys_init(bool format) {
     if (fs_device == NULL)
         PANIC("No file system device found, can't initialize file system.");
 
+    cache_init();
     inode_init();
+    dcache_init();
     free_map_init();
+    journal_init();
 
     if (format) 
         do_format();
 
+    journal_open();
     free_map_open();
 }
 
 /*! Shuts down the file system module, writing any unwritten data to disk. */
 void filesys_done(void) {
+    journal_close();
     free_map_close();
+    cache_flush();
 }
 
+/*! Writes every change made to the file system so far to disk: file data
+    first, then, in one journal commit, the metadata that refers to it. */
+void filesys_sync(void) {
+    cache_flush();
+    journal_commit();
+}
+
 /*! Creates a file named NAME with the given INITIAL_SIZE.  Returns true if
     successful, false otherwise.  Fails if a file named NAME already exists,
     or if internal memory allocation fails. */
 bool filesys_create(const char *name, off_t initial_size) {
     block_sector_t inode_sector = 0;
     struct dir *dir = dir_open_root();
-    bool success = (dir != NULL &&
-                    free_map_allocate(1, &inode_sector) &&
-                    inode_create(inode_sector, initial_size) &&
-                    dir_add(dir, name, inode_sector));
+    bool success;
+
+    journal_begin();
+    success = (dir != NULL &&
+               free_map_allocate_near(
+                   1, inode_get_inumber(dir_get_inode(dir)), &inode_sector) &&
+               inode_create(inode_sector, initial_size, false) &&
+               dir_add(dir, name, inode_sector));
     if (!success && inode_sector != 0) 
         free_map_release(inode_sector, 1);
+    journal_end();
     dir_close(dir);
 
     return success;
@@ -69,7 +90,11 @@ struct file * filesys_open(const char *name) {
     fails. */
 bool filesys_remove(const char *name) {
     struct dir *dir = dir_open_root();
-    bool success = dir != NULL && dir_remove(dir, name);
+    bool success;
+
+    journal_begin();
+    success = dir != NULL && dir_remove(dir, name);
+    journal_end();
     dir_close(dir);
 
     return success;
@@ -78,6 +103,7 @@ bool filesys_remove(const char *name) {
 /*! Formats the file system. */
 static void do_format(void) {
     printf("Formatting file system...");
+    journal_create();
     free_map_create();
     if (!dir_create(ROOT_DIR_SECTOR, 16))
         PANIC("root directory creation failed");
@@ -1,43 +1,207 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /*!< Free map file. */
 static struct bitmap *free_map;      /*!< Free map, one bit per sector. */
+static struct lock free_map_lock;    /*!< Protects the maps below. */
+
+/*! Sectors of the free map file whose contents changed since they were last
+    written, one bit per sector.  Only these are rewritten by
+    free_map_flush(), instead of the whole file on every allocation. */
+static struct bitmap *dirty_map;
+
+/*! The sectors of DIRTY_MAP that hold bits set by an allocation.  The
+    journal commit that logs an operation must log these too, since the
+    operation's metadata may point to the sectors they allocate.  Sectors
+    whose bits were only cleared may wait for a later commit; a crash in
+    between only leaks the released sectors. */
+static struct bitmap *alloc_map;
+
+/*! Sectors released since the last journal commit, one bit per sector.
+    They stay allocated in FREE_MAP until free_map_commit_releases().
+    Reusing one sooner would let a crash bring back the metadata that
+    pointed to it, now pointing at another file's data. */
+static struct bitmap *release_map;
+
+/*! Number of bits set in RELEASE_MAP. */
+static size_t release_cnt;
+
+/*! Number of free map bits stored in one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/*! Records that the bits for sectors START through START + CNT - 1 must be
+    written back.  ALLOCATED is true if they were set. */
+static void mark_dirty(block_sector_t start, size_t cnt, bool allocated) {
+    size_t first = start / BITS_PER_SECTOR;
+    size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+    bitmap_set_multiple(dirty_map, first, last - first + 1, true);
+    if (allocated)
+        bitmap_set_multiple(alloc_map, first, last - first + 1, true);
+}
 
 /*! Initializes the free map. */
 void free_map_init(void) {
-    free_map = bitmap_create(block_size(fs_device));
-    if (free_map == NULL)
+    size_t bit_cnt = block_size(fs_device);
+    free_map = bitmap_create(bit_cnt);
+    dirty_map = bitmap_create(DIV_ROUND_UP(bit_cnt, BITS_PER_SECTOR));
+    alloc_map = bitmap_create(DIV_ROUND_UP(bit_cnt, BITS_PER_SECTOR));
+    release_map = bitmap_create(bit_cnt);
+    if (free_map == NULL || dirty_map == NULL || alloc_map == NULL
+        || release_map == NULL)
         PANIC("bitmap creation failed--file system device is too large");
+    lock_init(&free_map_lock);
     bitmap_mark(free_map, FREE_MAP_SECTOR);
     bitmap_mark(free_map, ROOT_DIR_SECTOR);
+    bitmap_set_multiple(free_map, JOURNAL_SECTOR, JOURNAL_SIZE, true);
+}
+
+/*! Allocates CNT consecutive sectors from the free map and stores the first
+    into *SECTORP.  Prefers the first free run at or after HINT, so that
+    callers passing the sector of an inode or of its previous extent keep
+    related data close together on disk; falls back to the first free run
+    anywhere on the device.
+    Returns true if successful, false if not enough consecutive sectors were
+    available.  The change reaches disk at the next free_map_flush(). */
+bool free_map_allocate_near(size_t cnt, block_sector_t hint,
+                            block_sector_t *sectorp) {
+    block_sector_t sector = BITMAP_ERROR;
+
+    lock_acquire(&free_map_lock);
+    if (hint < bitmap_size(free_map))
+        sector = bitmap_scan_and_flip(free_map, hint, cnt, false);
+    if (sector == BITMAP_ERROR && hint != 0)
+        sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
+    if (sector != BITMAP_ERROR)
+        mark_dirty(sector, cnt, true);
+    lock_release(&free_map_lock);
+
+    if (sector == BITMAP_ERROR)
+        return false;
+    *sectorp = sector;
+    return true;
 }
 
 /*! Allocates CNT consecutive sectors from the free map and stores the first
     into *SECTORP.
     Returns true if successful, false if not enough consecutive sectors were
-    available or if the free_map file could not be written. */
+    available. */
 bool free_map_allocate(size_t cnt, block_sector_t *sectorp) {
-    block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-    if (sector != BITMAP_ERROR && free_map_file != NULL &&
-        !bitmap_write(free_map, free_map_file)) {
-        bitmap_set_multiple(free_map, sector, cnt, false); 
-        sector = BITMAP_ERROR;
-    }
-    if (sector != BITMAP_ERROR)
-        *sectorp = sector;
-    return sector != BITMAP_ERROR;
+    return free_map_allocate_near(cnt, 0, sectorp);
 }
 
-/*! Makes CNT sectors starting at SECTOR available for use. */
+/*! Makes CNT sectors starting at SECTOR available for use, once the
+    journal commits the operation that released them. */
 void free_map_release(block_sector_t sector, size_t cnt) {
+    lock_acquire(&free_map_lock);
     ASSERT(bitmap_all(free_map, sector, cnt));
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    bitmap_write(free_map, free_map_file);
+    ASSERT(bitmap_none(release_map, sector, cnt));
+    bitmap_set_multiple(release_map, sector, cnt, true);
+    release_cnt += cnt;
+    lock_release(&free_map_lock);
+}
+
+/*! Makes the sectors passed to free_map_release() so far available for
+    use.  The journal calls this after writing a commit's header.  Every
+    release comes from an operation that had already ended when the commit
+    started (inode_close() releases only after the remove has ended), so
+    that commit or an earlier one logs it. */
+void free_map_commit_releases(void) {
+    size_t start = 0;
+
+    lock_acquire(&free_map_lock);
+    while (release_cnt > 0) {
+        size_t end;
+
+        start = bitmap_scan(release_map, start, 1, true);
+        ASSERT(start != BITMAP_ERROR);
+        end = bitmap_scan(release_map, start, 1, false);
+        if (end == BITMAP_ERROR)
+            end = bitmap_size(release_map);
+
+        bitmap_set_multiple(release_map, start, end - start, false);
+        bitmap_set_multiple(free_map, start, end - start, false);
+        mark_dirty(start, end - start, false);
+        release_cnt -= end - start;
+        start = end;
+    }
+    lock_release(&free_map_lock);
+}
+
+/*! Returns true if some released sectors wait for a journal commit. */
+bool free_map_releases_pending(void) {
+    bool pending;
+
+    lock_acquire(&free_map_lock);
+    pending = release_cnt > 0;
+    lock_release(&free_map_lock);
+    return pending;
+}
+
+/*! Returns the number of sectors of the free map that hold bits allocated
+    since they were last written, all of which the next free_map_flush()
+    writes. */
+size_t free_map_pending(void) {
+    size_t cnt;
+
+    lock_acquire(&free_map_lock);
+    cnt = bitmap_count(alloc_map, 0, bitmap_size(alloc_map), true);
+    lock_release(&free_map_lock);
+    return cnt;
+}
+
+/*! Writes modified sectors of the free map to the free map file: every
+    sector that holds newly allocated bits, and then others while fewer
+    than ROOM sectors have been written.  Pass SIZE_MAX to write them all.
+    Returns true if successful, false if a write failed, in which case the
+    unwritten sectors stay marked for a later attempt. */
+bool free_map_flush(size_t room) {
+    size_t written = 0;
+    size_t i;
+
+    if (free_map_file == NULL)
+        return true;
+
+    /* Writing the file may itself allocate sectors for it, dirtying more of
+       the map, so keep going until nothing is left.  The write happens
+       without `free_map_lock', since it may allocate; a concurrent change
+       to the sector being written marks it dirty again. */
+    for (;;) {
+        bool allocated = true;
+
+        lock_acquire(&free_map_lock);
+        i = bitmap_scan(alloc_map, 0, 1, true);
+        if (i == BITMAP_ERROR && written < room) {
+            i = bitmap_scan(dirty_map, 0, 1, true);
+            allocated = false;
+        }
+        if (i != BITMAP_ERROR) {
+            bitmap_reset(dirty_map, i);
+            bitmap_reset(alloc_map, i);
+        }
+        lock_release(&free_map_lock);
+        if (i == BITMAP_ERROR)
+            return true;
+
+        if (!bitmap_write_partial(free_map, free_map_file,
+                                  i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE)) {
+            lock_acquire(&free_map_lock);
+            bitmap_mark(dirty_map, i);
+            if (allocated)
+                bitmap_mark(alloc_map, i);
+            lock_release(&free_map_lock);
+            return false;
+        }
+        written++;
+    }
 }
 
 /*! Opens the free map file and reads it from disk. */
@@ -47,24 +211,33 @@ void free_map_open(void) {
         PANIC("can't open free map");
     if (!bitmap_read(free_map, free_map_file))
         PANIC("can't read free map");
+    bitmap_set_all(dirty_map, false);
+    bitmap_set_all(alloc_map, false);
+    bitmap_set_all(release_map, false);
+    release_cnt = 0;
 }
 
 /*! Writes the free map to disk and closes the free map file. */
 void free_map_close(void) {
+    /* The journal is closed by now, so nothing is left to commit. */
+    free_map_commit_releases();
+    if (!free_map_flush(SIZE_MAX))
+        printf("free map: write failed\n");
     file_close(free_map_file);
+    free_map_file = NULL;
 }
 
 /*! Creates a new free map file on disk and writes the free map to it. */
 void free_map_create(void) {
     /* Create inode. */
-    if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map)))
+    if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map), true))
         PANIC("free map creation failed");
 
     /* Write bitmap to file. */
     free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
     if (free_map_file == NULL)
         PANIC("can't open free map");
-    if (!bitmap_write(free_map, free_map_file))
+    bitmap_set_all(dirty_map, true);
+    if (!free_map_flush(SIZE_MAX))
         PANIC("can't write free map");
 }
-
@@ -12,7 +12,12 @@ void free_map_open(void);
 void free_map_close(void);
 
 bool free_map_allocate(size_t, block_sector_t *);
+bool free_map_allocate_near(size_t, block_sector_t hint, block_sector_t *);
 void free_map_release(block_sector_t, size_t);
+void free_map_commit_releases(void);
+bool free_map_releases_pending(void);
+size_t free_map_pending(void);
+bool free_map_flush(size_t room);
 
 #endif /* filesys/free-map.h */
 
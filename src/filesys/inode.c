@@ -3,20 +3,65 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /*! Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/*! Number of data sectors addressed directly by the inode. */
+#define INODE_DIRECT_CNT 123
+
+/*! Inode flags. @{ */
+#define INODE_F_METADATA 0x1    /*!< Data is journaled (directories etc.). */
+#define INODE_F_INLINE 0x2      /*!< Data is stored in the inode itself. */
+/*! @} */
+
+/*! Largest file whose data fits in the inode sector, in place of its
+    index. */
+#define INODE_INLINE_MAX ((INODE_DIRECT_CNT + 2) * sizeof(block_sector_t))
+
+/*! Number of sector numbers held by one index sector. */
+#define INODE_PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof(block_sector_t))
+
+/*! Largest number of data sectors an inode can address. */
+#define INODE_MAX_SECTORS (INODE_DIRECT_CNT + INODE_PTRS_PER_SECTOR + \
+                           INODE_PTRS_PER_SECTOR * INODE_PTRS_PER_SECTOR)
+
+/*! Largest file size, in bytes. */
+#define INODE_MAX_LENGTH ((off_t) (INODE_MAX_SECTORS * BLOCK_SECTOR_SIZE))
+
 /*! On-disk inode.
-    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+    Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+    Data sectors are found through a multilevel index.  A sector number of 0
+    (the free map inode, which is never file data) marks a hole: that part of
+    the file has never been written, reads as zeros, and has no sector
+    allocated for it yet.
+
+    A file of at most INODE_INLINE_MAX bytes instead keeps its data in the
+    space of the index (INODE_F_INLINE), so that creating or reading it
+    touches only the inode sector.  It moves out to a data sector the first
+    time it grows past that size.
+
+    The inode itself and its index sectors always go through the journal;
+    its data does only if INODE_F_METADATA is set. */
 struct inode_disk {
-    block_sector_t start;               /*!< First data sector. */
     off_t length;                       /*!< File size in bytes. */
     unsigned magic;                     /*!< Magic number. */
-    uint32_t unused[125];               /*!< Not used. */
+    unsigned flags;                     /*!< INODE_F_* flags. */
+    union {
+        struct {
+            block_sector_t direct[INODE_DIRECT_CNT];    /*!< Data sectors. */
+            block_sector_t indirect;    /*!< Index of data sectors. */
+            block_sector_t doubly_indirect; /*!< Index of indirect sectors. */
+        };
+        uint8_t inline_data[INODE_INLINE_MAX];  /*!< With INODE_F_INLINE. */
+    };
 };
 
 /*! Returns the number of sectors to allocate for an inode SIZE
@@ -25,43 +70,242 @@ static inline size_t bytes_to_sectors(off_t size) {
     return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE);
 }
 
-/*! In-memory inode. */
+/*! In-memory inode.
+
+    ELEM and OPEN_CNT are protected by `open_inodes_lock'.  Reads of the
+    file's data hold RW for reading; writes, which may change the sector
+    index in DATA, hold it for writing.  REMOVED, DENY_WRITE_CNT and the
+    length are protected by META_LOCK. */
 struct inode {
     struct list_elem elem;              /*!< Element in inode list. */
     block_sector_t sector;              /*!< Sector number of disk location. */
     int open_cnt;                       /*!< Number of openers. */
     bool removed;                       /*!< True if deleted, false otherwise. */
     int deny_write_cnt;                 /*!< 0: writes ok, >0: deny writes. */
+    block_sector_t last_alloc;          /*!< Most recently allocated sector. */
+    struct rwlock rw;                   /*!< Readers share, writers exclude. */
+    struct lock meta_lock;              /*!< Protects metadata, see above. */
+    struct lock dir_lock;               /*!< Serializes directory updates. */
     struct inode_disk data;             /*!< Inode content. */
 };
 
-/*! Returns the block device sector that contains byte offset POS
-    within INODE.
-    Returns -1 if INODE does not contain data for a byte at offset
-    POS. */
-static block_sector_t byte_to_sector(const struct inode *inode, off_t pos) {
-    ASSERT(inode != NULL);
-    if (pos < inode->data.length)
-        return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+/*! Reads entry IDX of the index sector TABLE into *PTR. */
+static void index_read(block_sector_t table, size_t idx, block_sector_t *ptr) {
+    cache_read_at(table, ptr, idx * sizeof *ptr, sizeof *ptr);
+}
+
+/*! Stores PTR as entry IDX of the index sector TABLE. */
+static void index_write(block_sector_t table, size_t idx, block_sector_t ptr) {
+    journal_write_at(table, &ptr, idx * sizeof ptr, sizeof ptr);
+}
+
+/*! Writes INODE's on-disk inode back through the journal. */
+static void inode_write_disk(struct inode *inode) {
+    journal_write_at(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+}
+
+/*! Allocates a sector for INODE close to the one it allocated last, and
+    stores it in *SECTORP.  If ZERO is true, also clears the new sector,
+    without reading it from disk, as a new index sector.  Returns false if
+    the disk is full. */
+static bool allocate_sector(struct inode *inode, bool zero,
+                            block_sector_t *sectorp) {
+    if (!free_map_allocate_near(1, inode->last_alloc, sectorp))
+        return false;
+    inode->last_alloc = *sectorp;
+    if (zero)
+        journal_zero(*sectorp);
+    return true;
+}
+
+/*! Looks up entry IDX of the index rooted at *SLOT, where *SLOT is either a
+    field of INODE's on-disk inode or entry SLOT_IDX of the index sector
+    SLOT_TABLE (if SLOT is null).  Index sectors are allocated on the way down
+    when ALLOCATE is true. */
+static bool index_lookup(struct inode *inode, block_sector_t *slot,
+                         block_sector_t slot_table, size_t slot_idx,
+                         bool allocate, block_sector_t *tablep) {
+    block_sector_t table;
+
+    if (slot != NULL)
+        table = *slot;
     else
-        return -1;
+        index_read(slot_table, slot_idx, &table);
+
+    if (table == 0 && allocate) {
+        if (!allocate_sector(inode, true, &table))
+            return false;
+        if (slot != NULL) {
+            *slot = table;
+            inode_write_disk(inode);
+        }
+        else {
+            index_write(slot_table, slot_idx, table);
+        }
+    }
+    *tablep = table;
+    return true;
+}
+
+/*! Finds the data sector holding the IDX'th sector of INODE's data and
+    stores it in *SECTORP, or stores 0 if that part of the file is a hole.
+    If ALLOCATE is true, a hole is instead filled by allocating a new data
+    sector (and any index sectors needed to reach it); the new data sector is
+    not initialized, and *FRESHP is set to true so that the caller knows its
+    old contents are zeros rather than whatever is on disk.
+    Returns false if allocation fails. */
+static bool get_sector(struct inode *inode, size_t idx, bool allocate,
+                       block_sector_t *sectorp, bool *freshp) {
+    block_sector_t *slot = NULL;
+    block_sector_t table = 0;
+    size_t table_idx = 0;
+
+    if (freshp != NULL)
+        *freshp = false;
+    *sectorp = 0;
+
+    if (idx < INODE_DIRECT_CNT) {
+        slot = &inode->data.direct[idx];
+    }
+    else if (idx < INODE_DIRECT_CNT + INODE_PTRS_PER_SECTOR) {
+        if (!index_lookup(inode, &inode->data.indirect, 0, 0, allocate,
+                          &table))
+            return false;
+        table_idx = idx - INODE_DIRECT_CNT;
+    }
+    else if (idx < INODE_MAX_SECTORS) {
+        block_sector_t outer;
+        idx -= INODE_DIRECT_CNT + INODE_PTRS_PER_SECTOR;
+        if (!index_lookup(inode, &inode->data.doubly_indirect, 0, 0,
+                          allocate, &outer))
+            return false;
+        if (outer == 0)
+            return true;
+        if (!index_lookup(inode, NULL, outer, idx / INODE_PTRS_PER_SECTOR,
+                          allocate, &table))
+            return false;
+        table_idx = idx % INODE_PTRS_PER_SECTOR;
+    }
+    else {
+        return false;
+    }
+
+    /* Find the data sector itself. */
+    if (slot != NULL) {
+        *sectorp = *slot;
+    }
+    else {
+        if (table == 0)
+            return true;
+        index_read(table, table_idx, sectorp);
+    }
+    if (*sectorp != 0 || !allocate)
+        return true;
+
+    /* Fill the hole. */
+    if (!allocate_sector(inode, false, sectorp))
+        return false;
+    if (slot != NULL) {
+        *slot = *sectorp;
+        inode_write_disk(inode);
+    }
+    else {
+        index_write(table, table_idx, *sectorp);
+    }
+    if (freshp != NULL)
+        *freshp = true;
+    return true;
+}
+
+/*! Releases the sectors of the index rooted at TABLE, which is LEVEL levels
+    above the data sectors, along with TABLE itself. */
+static void release_index(block_sector_t table, int level) {
+    block_sector_t ptr;
+    size_t i;
+
+    if (table == 0)
+        return;
+    if (level > 0) {
+        for (i = 0; i < INODE_PTRS_PER_SECTOR; i++) {
+            index_read(table, i, &ptr);
+            release_index(ptr, level - 1);
+        }
+    }
+    free_map_release(table, 1);
+}
+
+/*! Returns true if INODE keeps its data in the inode sector. */
+static inline bool is_inline(const struct inode *inode) {
+    return (inode->data.flags & INODE_F_INLINE) != 0;
+}
+
+/*! Sets INODE's length to LENGTH.  Must be called inside a journal
+    operation, with INODE's RW held for writing. */
+static void set_length(struct inode *inode, off_t length) {
+    lock_acquire(&inode->meta_lock);
+    inode->data.length = length;
+    lock_release(&inode->meta_lock);
+    inode_write_disk(inode);
+}
+
+/*! Moves the data of inline INODE out to a newly allocated data sector,
+    making room for an index.  Must be called inside a journal operation,
+    with INODE's RW held for writing.  Returns false, leaving INODE
+    unchanged, if memory or disk space runs out. */
+static bool spill_inline(struct inode *inode) {
+    uint8_t *sector_data;
+    block_sector_t sector;
+    off_t length = inode_length(inode);
+
+    ASSERT(is_inline(inode));
+
+    sector_data = calloc(1, BLOCK_SECTOR_SIZE);
+    if (sector_data == NULL)
+        return false;
+    memcpy(sector_data, inode->data.inline_data, INODE_INLINE_MAX);
+
+    memset(inode->data.inline_data, 0, INODE_INLINE_MAX);
+    inode->data.flags &= ~INODE_F_INLINE;
+    if (length > 0) {
+        if (!get_sector(inode, 0, true, &sector, NULL)) {
+            memcpy(inode->data.inline_data, sector_data, INODE_INLINE_MAX);
+            inode->data.flags |= INODE_F_INLINE;
+            free(sector_data);
+            return false;
+        }
+        if (inode->data.flags & INODE_F_METADATA)
+            journal_write_at(sector, sector_data, 0, BLOCK_SECTOR_SIZE);
+        else
+            cache_write_at(sector, sector_data, 0, BLOCK_SECTOR_SIZE);
+    }
+    inode_write_disk(inode);
+    free(sector_data);
+    return true;
 }
 
 /*! List of open inodes, so that opening a single inode twice
     returns the same `struct inode'. */
 static struct list open_inodes;
 
+/*! Protects `open_inodes' and the open counts of its members. */
+static struct lock open_inodes_lock;
+
 /*! Initializes the inode module. */
 void inode_init(void) {
     list_init(&open_inodes);
+    lock_init(&open_inodes_lock);
 }
 
 /*! Initializes an inode with LENGTH bytes of data and
     writes the new inode to sector SECTOR on the file system
-    device.
+    device.  No data sectors are allocated: the file starts out as one big
+    hole, and each data sector is allocated when it is first written.
+    A file small enough keeps its data inline in the inode sector instead.
+    If METADATA is true, writes to the data are journaled too, as for
+    directories and the free map.
     Returns true if successful.
-    Returns false if memory or disk allocation fails. */
-bool inode_create(block_sector_t sector, off_t length) {
+    Returns false if memory allocation fails or LENGTH is too large. */
+bool inode_create(block_sector_t sector, off_t length, bool metadata) {
     struct inode_disk *disk_inode = NULL;
     bool success = false;
 
@@ -71,22 +315,18 @@ bool inode_create(block_sector_t sector, off_t length) {
        one sector in size, and you should fix that. */
     ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+    if (bytes_to_sectors(length) > INODE_MAX_SECTORS)
+        return false;
+
     disk_inode = calloc(1, sizeof *disk_inode);
     if (disk_inode != NULL) {
-        size_t sectors = bytes_to_sectors(length);
         disk_inode->length = length;
         disk_inode->magic = INODE_MAGIC;
-        if (free_map_allocate(sectors, &disk_inode->start)) {
-            block_write(fs_device, sector, disk_inode);
-            if (sectors > 0) {
-                static char zeros[BLOCK_SECTOR_SIZE];
-                size_t i;
-              
-                for (i = 0; i < sectors; i++) 
-                    block_write(fs_device, disk_inode->start + i, zeros);
-            }
-            success = true; 
-        }
+        disk_inode->flags = metadata ? INODE_F_METADATA : 0;
+        if (length <= (off_t) INODE_INLINE_MAX)
+            disk_inode->flags |= INODE_F_INLINE;
+        journal_write_at(sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+        success = true; 
         free(disk_inode);
     }
     return success;
@@ -99,35 +339,49 @@ struct inode * inode_open(block_sector_t sector) {
     struct list_elem *e;
     struct inode *inode;
 
+    lock_acquire(&open_inodes_lock);
+
     /* Check whether this inode is already open. */
     for (e = list_begin(&open_inodes); e != list_end(&open_inodes);
          e = list_next(e)) {
         inode = list_entry(e, struct inode, elem);
         if (inode->sector == sector) {
-            inode_reopen(inode);
+            inode->open_cnt++;
+            lock_release(&open_inodes_lock);
             return inode; 
         }
     }
 
     /* Allocate memory. */
     inode = malloc(sizeof *inode);
-    if (inode == NULL)
+    if (inode == NULL) {
+        lock_release(&open_inodes_lock);
         return NULL;
+    }
 
-    /* Initialize. */
-    list_push_front(&open_inodes, &inode->elem);
+    /* Initialize.  The inode stays invisible to other openers until its
+       contents have been read. */
     inode->sector = sector;
     inode->open_cnt = 1;
     inode->deny_write_cnt = 0;
     inode->removed = false;
-    block_read(fs_device, inode->sector, &inode->data);
+    inode->last_alloc = sector;
+    rwlock_init(&inode->rw);
+    lock_init(&inode->meta_lock);
+    lock_init(&inode->dir_lock);
+    cache_read_at(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    list_push_front(&open_inodes, &inode->elem);
+    lock_release(&open_inodes_lock);
     return inode;
 }
 
 /*! Reopens and returns INODE. */
 struct inode * inode_reopen(struct inode *inode) {
-    if (inode != NULL)
+    if (inode != NULL) {
+        lock_acquire(&open_inodes_lock);
         inode->open_cnt++;
+        lock_release(&open_inodes_lock);
+    }
     return inode;
 }
 
@@ -140,20 +394,34 @@ block_sector_t inode_get_inumber(const struct inode *inode) {
     If this was the last reference to INODE, frees its memory.
     If INODE was also a removed inode, frees its blocks. */
 void inode_close(struct inode *inode) {
+    bool last;
+
     /* Ignore null pointer. */
     if (inode == NULL)
         return;
 
-    /* Release resources if this was the last opener. */
-    if (--inode->open_cnt == 0) {
-        /* Remove from inode list and release lock. */
+    lock_acquire(&open_inodes_lock);
+    last = --inode->open_cnt == 0;
+    if (last) {
+        /* Remove from inode list, so that nobody can find it again. */
         list_remove(&inode->elem);
- 
+    }
+    lock_release(&open_inodes_lock);
+
+    /* Release resources if this was the last opener. */
+    if (last) {
         /* Deallocate blocks if removed. */
         if (inode->removed) {
+            if (!is_inline(inode)) {
+                size_t i;
+                for (i = 0; i < INODE_DIRECT_CNT; i++) {
+                    if (inode->data.direct[i] != 0)
+                        free_map_release(inode->data.direct[i], 1);
+                }
+                release_index(inode->data.indirect, 1);
+                release_index(inode->data.doubly_indirect, 2);
+            }
             free_map_release(inode->sector, 1);
-            free_map_release(inode->data.start,
-                             bytes_to_sectors(inode->data.length)); 
         }
 
         free(inode); 
@@ -164,20 +432,37 @@ void inode_close(struct inode *inode) {
     has it open. */
 void inode_remove(struct inode *inode) {
     ASSERT(inode != NULL);
+    lock_acquire(&inode->meta_lock);
     inode->removed = true;
+    lock_release(&inode->meta_lock);
 }
 
-/*! Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset) {
-    uint8_t *buffer = buffer_;
+/*! Passes SIZE bytes of INODE's data, starting at position OFFSET, to FUNC
+    along with AUX, a piece at a time and in order, straight from the
+    buffer cache (or the inode, for inline data) without copying them.
+    FUNC must not use the file system.
+    Returns the number of bytes passed, which may be less than SIZE if an
+    error occurs or end of file is reached. */
+off_t inode_read_with(struct inode *inode, off_t size, off_t offset,
+                      cache_read_func *func, void *aux) {
+    static const uint8_t zeros[BLOCK_SECTOR_SIZE];
     off_t bytes_read = 0;
-    uint8_t *bounce = NULL;
 
+    rwlock_acquire_read(&inode->rw);
+    if (is_inline(inode)) {
+        /* Straight out of the in-memory copy of the inode. */
+        off_t inode_left = inode_length(inode) - offset;
+        if (size > inode_left)
+            size = inode_left;
+        if (size > 0) {
+            func(inode->data.inline_data + offset, size, aux);
+            bytes_read = size;
+        }
+        size = 0;
+    }
     while (size > 0) {
         /* Disk sector to read, starting byte offset within sector. */
-        block_sector_t sector_idx = byte_to_sector (inode, offset);
+        block_sector_t sector_idx;
         int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -185,25 +470,22 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
         int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
         int min_left = inode_left < sector_left ? inode_left : sector_left;
 
-        /* Number of bytes to actually copy out of this sector. */
+        /* Number of bytes to actually pass on from this sector. */
         int chunk_size = size < min_left ? size : min_left;
         if (chunk_size <= 0)
             break;
 
-        if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-            /* Read full sector directly into caller's buffer. */
-            block_read (fs_device, sector_idx, buffer + bytes_read);
+        if (!get_sector(inode, offset / BLOCK_SECTOR_SIZE, false,
+                        &sector_idx, NULL))
+            break;
+
+        if (sector_idx == 0) {
+            /* Never written: zeros, without touching the disk. */
+            func(zeros, chunk_size, aux);
         }
         else {
-            /* Read sector into bounce buffer, then partially copy
-               into caller's buffer. */
-            if (bounce == NULL) {
-                bounce = malloc(BLOCK_SECTOR_SIZE);
-                if (bounce == NULL)
-                    break;
-            }
-            block_read(fs_device, sector_idx, bounce);
-            memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
+            /* Straight out of the cached sector. */
+            cache_read_with(sector_idx, sector_ofs, chunk_size, func, aux);
         }
       
         /* Advance. */
@@ -211,27 +493,79 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
         offset += chunk_size;
         bytes_read += chunk_size;
     }
-    free(bounce);
+    rwlock_release_read(&inode->rw);
 
     return bytes_read;
 }
 
+/*! cache_read_func for inode_read_at(): copies the data to *AUX, a buffer
+    pointer, and advances it. */
+static void copy_out(const void *data, size_t size, void *aux) {
+    uint8_t **buffer = aux;
+
+    memcpy(*buffer, data, size);
+    *buffer += size;
+}
+
+/*! Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t inode_read_at(struct inode *inode, void *buffer, off_t size, off_t offset) {
+    uint8_t *pos = buffer;
+
+    return inode_read_with(inode, size, offset, copy_out, &pos);
+}
+
 /*! Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
     Returns the number of bytes actually written, which may be
-    less than SIZE if end of file is reached or an error occurs.
-    (Normally a write at end of file would extend the inode, but
-    growth is not yet implemented.) */
+    less than SIZE if the disk fills up or an error occurs.
+    Writing past end of file extends the inode. */
 off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t offset) {
     const uint8_t *buffer = buffer_;
     off_t bytes_written = 0;
-    uint8_t *bounce = NULL;
-
-    if (inode->deny_write_cnt)
+    off_t start = offset;
+    bool metadata = (inode->data.flags & INODE_F_METADATA) != 0;
+    off_t length, end;
+    bool denied;
+
+    lock_acquire(&inode->meta_lock);
+    denied = inode->deny_write_cnt > 0;
+    lock_release(&inode->meta_lock);
+    if (denied)
         return 0;
 
+    rwlock_acquire_write(&inode->rw);
+
+    /* Grow the file first, moving its data out of the inode sector if it
+       no longer fits there.  If that fails, write what fits. */
+    length = inode_length(inode);
+    end = offset + size < INODE_MAX_LENGTH ? offset + size : INODE_MAX_LENGTH;
+    if (end > length) {
+        journal_begin();
+        if (!is_inline(inode) || end <= (off_t) INODE_INLINE_MAX ||
+            spill_inline(inode))
+            set_length(inode, end);
+        journal_end();
+    }
+
+    if (is_inline(inode)) {
+        /* The data goes to the inode sector, which is always journaled. */
+        off_t inode_left = inode_length(inode) - offset;
+        if (size > inode_left)
+            size = inode_left;
+        if (size > 0) {
+            journal_begin();
+            memcpy(inode->data.inline_data + offset, buffer, size);
+            inode_write_disk(inode);
+            journal_end();
+            bytes_written = size;
+        }
+        size = 0;
+    }
     while (size > 0) {
         /* Sector to write, starting byte offset within sector. */
-        block_sector_t sector_idx = byte_to_sector(inode, offset);
+        block_sector_t sector_idx;
+        bool fresh;
         int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -244,29 +578,38 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
         if (chunk_size <= 0)
             break;
 
-        if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-            /* Write full sector directly to disk. */
-            block_write(fs_device, sector_idx, buffer + bytes_written);
+        /* Allocate the sector on its first write, in one journal
+           operation with the index updates that record it. */
+        if (!get_sector(inode, offset / BLOCK_SECTOR_SIZE, false,
+                        &sector_idx, &fresh))
+            break;
+        if (sector_idx == 0) {
+            bool allocated;
+
+            journal_begin();
+            allocated = get_sector(inode, offset / BLOCK_SECTOR_SIZE, true,
+                                   &sector_idx, &fresh);
+            journal_end();
+            if (!allocated)
+                break;
+        }
+
+        /* A partial write into a sector that was only just allocated
+           must not pick up whatever the disk held there before.
+           Otherwise the cache reads the sector only if the chunk does
+           not cover all of it, and defers the disk write, so that
+           repeated small writes to one sector cost one disk write. */
+        if (metadata) {
+            if (fresh && chunk_size < BLOCK_SECTOR_SIZE)
+                journal_zero(sector_idx);
+            journal_write_at(sector_idx, buffer + bytes_written, sector_ofs,
+                             chunk_size);
         }
         else {
-            /* We need a bounce buffer. */
-            if (bounce == NULL) {
-                bounce = malloc(BLOCK_SECTOR_SIZE);
-                if (bounce == NULL)
-                    break;
-            }
-
-            /* If the sector contains data before or after the chunk
-               we're writing, then we need to read in the sector
-               first.  Otherwise we start with a sector of all zeros. */
-
-            if (sector_ofs > 0 || chunk_size < sector_left) 
-                block_read(fs_device, sector_idx, bounce);
-            else
-                memset (bounce, 0, BLOCK_SECTOR_SIZE);
-
-            memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size);
-            block_write(fs_device, sector_idx, bounce);
+            if (fresh && chunk_size < BLOCK_SECTOR_SIZE)
+                cache_zero(sector_idx);
+            cache_write_at(sector_idx, buffer + bytes_written, sector_ofs,
+                           chunk_size);
         }
 
         /* Advance. */
@@ -274,7 +617,16 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
         offset += chunk_size;
         bytes_written += chunk_size;
     }
-    free(bounce);
+
+    /* Give back growth that could not be filled, all of it if nothing was
+       written: a failed write past EOF must not leave a gap behind. */
+    if (inode_length(inode) > length && start + bytes_written < end) {
+        journal_begin();
+        set_length(inode, bytes_written > 0 && start + bytes_written > length
+                          ? start + bytes_written : length);
+        journal_end();
+    }
+    rwlock_release_write(&inode->rw);
 
     return bytes_written;
 }
@@ -282,21 +634,41 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
 /*! Disables writes to INODE.
     May be called at most once per inode opener. */
 void inode_deny_write (struct inode *inode) {
+    lock_acquire(&inode->meta_lock);
     inode->deny_write_cnt++;
     ASSERT(inode->deny_write_cnt <= inode->open_cnt);
+    lock_release(&inode->meta_lock);
 }
 
 /*! Re-enables writes to INODE.
     Must be called once by each inode opener who has called
     inode_deny_write() on the inode, before closing the inode. */
 void inode_allow_write (struct inode *inode) {
+    lock_acquire(&inode->meta_lock);
     ASSERT(inode->deny_write_cnt > 0);
     ASSERT(inode->deny_write_cnt <= inode->open_cnt);
     inode->deny_write_cnt--;
+    lock_release(&inode->meta_lock);
 }
 
 /*! Returns the length, in bytes, of INODE's data. */
-off_t inode_length(const struct inode *inode) {
-    return inode->data.length;
+off_t inode_length(struct inode *inode) {
+    off_t length;
+
+    lock_acquire(&inode->meta_lock);
+    length = inode->data.length;
+    lock_release(&inode->meta_lock);
+    return length;
+}
+
+/*! Acquires the lock that serializes directory operations on INODE, so that
+    checking for a name and adding or removing it happen atomically. */
+void inode_dir_lock_acquire(struct inode *inode) {
+    lock_acquire(&inode->dir_lock);
+}
+
+/*! Releases the lock acquired by inode_dir_lock_acquire(). */
+void inode_dir_lock_release(struct inode *inode) {
+    lock_release(&inode->dir_lock);
 }
 
@@ -4,20 +4,25 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include "filesys/cache.h"
 
 struct bitmap;
 
 void inode_init(void);
-bool inode_create(block_sector_t, off_t);
+bool inode_create(block_sector_t, off_t, bool metadata);
 struct inode *inode_open(block_sector_t);
 struct inode *inode_reopen(struct inode *);
 block_sector_t inode_get_inumber(const struct inode *);
 void inode_close(struct inode *);
 void inode_remove(struct inode *);
 off_t inode_read_at(struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_with(struct inode *, off_t size, off_t offset,
+                      cache_read_func *, void *aux);
 off_t inode_write_at(struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write(struct inode *);
 void inode_allow_write(struct inode *);
-off_t inode_length(const struct inode *);
+off_t inode_length(struct inode *);
+void inode_dir_lock_acquire(struct inode *);
+void inode_dir_lock_release(struct inode *);
 
 #endif /* filesys/inode.h */
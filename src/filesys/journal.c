@@ -0,0 +1,388 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/*! Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/*! Most distinct sectors a single operation between journal_begin() and
+    journal_end() may log: a new inode, a directory entry, and the inode and
+    index sectors updated to reach a newly allocated sector. */
+#define JOURNAL_OP_MAX 8
+
+/*! Most sectors of the free map a single operation may change by
+    allocating, one for each sector it allocates: a new inode, and a data
+    sector with the two index sectors that lead to it.  The commit logs
+    these as well. */
+#define JOURNAL_OP_ALLOC_MAX 4
+
+/*! Once this many sectors are logged, the group is committed as soon as no
+    operation is active.  Smaller groups wait, so that a burst of creates and
+    removes costs one journal write rather than one each. */
+#define JOURNAL_COMMIT_THRESHOLD (JOURNAL_BLOCKS / 2)
+
+/*! A smaller group is committed anyway once this many timer ticks have
+    passed since its first sector was logged, so that a change followed by
+    a quiet spell does not wait for shutdown to become durable. */
+#define JOURNAL_COMMIT_DELAY (5 * TIMER_FREQ)
+
+/*! On-disk journal header, at JOURNAL_SECTOR.
+    Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+    The CNT sectors that follow it hold images of SECTORS[0] through
+    SECTORS[CNT - 1] as of the commit.  CHECKSUM covers SEQ, CNT, SECTORS and
+    the images, so a commit that was interrupted while the images were being
+    written (overwriting the previous commit's) is recognized and ignored.
+    That loses nothing, because a commit writes its sectors home before the
+    next one starts. */
+struct journal_header {
+    unsigned magic;                     /*!< Magic number. */
+    uint32_t seq;                       /*!< Commit sequence number. */
+    uint32_t cnt;                       /*!< Number of logged sectors. */
+    uint32_t checksum;                  /*!< See above. */
+    block_sector_t sectors[JOURNAL_BLOCKS];     /*!< Home locations. */
+    uint32_t unused[124 - JOURNAL_BLOCKS];      /*!< Not used. */
+};
+
+/*! Metadata sectors changed since the last commit.  Each is held in the
+    buffer cache, so that it cannot reach its home location before the
+    commit that logs it. */
+static block_sector_t group[JOURNAL_BLOCKS];
+static size_t group_cnt;
+
+/*! Timer tick at which the first sector of the group was logged. */
+static int64_t group_start;
+
+/*! Sequence number of the last commit. */
+static uint32_t seq;
+
+/*! True once the file system is mounted.  Before that (while formatting)
+    metadata is written without logging. */
+static bool enabled;
+
+/*! Number of operations between journal_begin() and journal_end(). */
+static int active;
+
+/*! True while a commit is in progress. */
+static bool committing;
+
+/*! Protects the variables above. */
+static struct lock journal_lock;
+
+/*! Signaled when an operation ends or a commit finishes. */
+static struct condition journal_changed;
+
+/*! Points in a commit at which the "-crash" option stops the machine. */
+enum crash_point {
+    CRASH_NONE,                         /*!< Don't. */
+    CRASH_BEGIN,                        /*!< Before writing anything. */
+    CRASH_IMAGES,                       /*!< Halfway through the images. */
+    CRASH_HEADER                        /*!< Just after the header. */
+};
+
+/*! Set by journal_set_crash(). */
+static enum crash_point crash_point;
+
+/*! Used only by the thread committing or replaying. */
+static struct journal_header header;
+static uint8_t image[BLOCK_SECTOR_SIZE];
+
+static void commit_daemon(void *aux);
+
+/*! Adds SIZE bytes at BUF into the running checksum SUM (FNV-1a). */
+static uint32_t checksum_add(uint32_t sum, const void *buf_, size_t size) {
+    const uint8_t *buf = buf_;
+
+    while (size-- > 0)
+        sum = (sum ^ *buf++) * 16777619;
+    return sum;
+}
+
+/*! Returns the checksum of the fields of `header' that it covers, to which
+    the images are then added in order. */
+static uint32_t checksum_start(void) {
+    uint32_t sum = 2166136261u;
+
+    sum = checksum_add(sum, &header.seq, sizeof header.seq);
+    sum = checksum_add(sum, &header.cnt, sizeof header.cnt);
+    return checksum_add(sum, header.sectors,
+                        header.cnt * sizeof *header.sectors);
+}
+
+/*! Returns the checksum of `header' and the images that follow it on
+    disk. */
+static uint32_t checksum_header(void) {
+    uint32_t sum = checksum_start();
+    size_t i;
+
+    for (i = 0; i < header.cnt; i++) {
+        block_read(fs_device, JOURNAL_SECTOR + 1 + i, image);
+        sum = checksum_add(sum, image, BLOCK_SECTOR_SIZE);
+    }
+    return sum;
+}
+
+/*! Makes the first commit with anything to write stop the machine at POINT,
+    as a power failure would: "begin" before writing anything, "images"
+    halfway through writing the images, or "header" just after writing the
+    header.  Returns false if POINT is none of these. */
+bool journal_set_crash(const char *point) {
+    if (!strcmp(point, "begin"))
+        crash_point = CRASH_BEGIN;
+    else if (!strcmp(point, "images"))
+        crash_point = CRASH_IMAGES;
+    else if (!strcmp(point, "header"))
+        crash_point = CRASH_HEADER;
+    else
+        return false;
+    return true;
+}
+
+/*! Stops the machine if the "-crash" option asked for it at POINT. */
+static void maybe_crash(enum crash_point point) {
+    if (crash_point == point)
+        shutdown_crash();
+}
+
+/*! Initializes the journal module. */
+void journal_init(void) {
+    ASSERT(sizeof header == BLOCK_SECTOR_SIZE);
+
+    lock_init(&journal_lock);
+    cond_init(&journal_changed);
+    group_cnt = 0;
+    seq = 0;
+    enabled = committing = false;
+    active = 0;
+}
+
+/*! Writes an empty journal to a newly formatted file system. */
+void journal_create(void) {
+    memset(&header, 0, sizeof header);
+    block_write(fs_device, JOURNAL_SECTOR, &header);
+    seq = 0;
+}
+
+/*! Replays the last complete commit, if any, and starts logging metadata.
+    Must be called before anything else reads the file system. */
+void journal_open(void) {
+    size_t i;
+
+    block_read(fs_device, JOURNAL_SECTOR, &header);
+    if (header.magic == JOURNAL_MAGIC && header.cnt <= JOURNAL_BLOCKS &&
+        checksum_header() == header.checksum) {
+        /* Replaying a commit that already reached home is harmless, so
+           there is no need to know whether it did.  The images must be home
+           before the next commit overwrites them. */
+        for (i = 0; i < header.cnt; i++) {
+            block_read(fs_device, JOURNAL_SECTOR + 1 + i, image);
+            cache_write_at(header.sectors[i], image, 0, BLOCK_SECTOR_SIZE);
+            cache_flush_sector(header.sectors[i]);
+        }
+        seq = header.seq;
+    }
+    enabled = true;
+    thread_create("journal", PRI_DEFAULT, commit_daemon, NULL);
+}
+
+/*! Commits the current group.  Must be called with `journal_lock' held, no
+    operation active and no other commit in progress; releases the lock
+    while writing. */
+static void commit(void) {
+    struct thread *t = thread_current();
+    uint32_t sum;
+    size_t i;
+
+    ASSERT(lock_held_by_current_thread(&journal_lock));
+    ASSERT(active == 0 && !committing);
+
+    committing = true;
+    lock_release(&journal_lock);
+
+    /* Log the free map bits allocated by the group's operations, and as
+       many other changed ones as fit; the rest wait for a later commit.
+       Writing a small free map file, whose data is inline in its inode,
+       starts a journal operation of its own, which must not wait for this
+       commit to finish: count it as nested in the operation being
+       committed. */
+    t->journal_depth++;
+    if (!free_map_flush(JOURNAL_BLOCKS - group_cnt))
+        printf("journal: free map write failed\n");
+    t->journal_depth--;
+
+    if (group_cnt > 0) {
+        maybe_crash(CRASH_BEGIN);
+
+        header.magic = JOURNAL_MAGIC;
+        header.seq = seq + 1;
+        header.cnt = group_cnt;
+        memcpy(header.sectors, group, group_cnt * sizeof *group);
+        sum = checksum_start();
+        for (i = 0; i < group_cnt; i++) {
+            cache_read_at(group[i], image, 0, BLOCK_SECTOR_SIZE);
+            block_write(fs_device, JOURNAL_SECTOR + 1 + i, image);
+            sum = checksum_add(sum, image, BLOCK_SECTOR_SIZE);
+            if (i == group_cnt / 2)
+                maybe_crash(CRASH_IMAGES);
+        }
+        header.checksum = sum;
+
+        /* The commit point. */
+        block_write(fs_device, JOURNAL_SECTOR, &header);
+        seq++;
+        maybe_crash(CRASH_HEADER);
+
+        /* Write the group home while it is still held, so that the next
+           commit can overwrite its images.  No operation can change these
+           sectors meanwhile, so what goes home is exactly what was
+           committed. */
+        for (i = 0; i < group_cnt; i++) {
+            cache_flush_sector(group[i]);
+            cache_unhold(group[i]);
+        }
+        group_cnt = 0;
+    }
+
+    /* Sectors released by the operations just committed, or by earlier
+       ones, may now be reused. */
+    free_map_commit_releases();
+
+    lock_acquire(&journal_lock);
+    committing = false;
+    cond_broadcast(&journal_changed, &journal_lock);
+}
+
+/*! Commits the group once it is JOURNAL_COMMIT_DELAY ticks old, or as
+    soon as there are released sectors to make reusable, checking once a
+    second. */
+static void commit_daemon(void *aux UNUSED) {
+    for (;;) {
+        timer_sleep(TIMER_FREQ);
+
+        lock_acquire(&journal_lock);
+        if (enabled && !committing && active == 0 &&
+            ((group_cnt > 0 &&
+              timer_elapsed(group_start) >= JOURNAL_COMMIT_DELAY) ||
+             free_map_releases_pending()))
+            commit();
+        lock_release(&journal_lock);
+    }
+}
+
+/*! Commits everything logged so far, once the operations in progress have
+    ended. */
+void journal_commit(void) {
+    if (!enabled)
+        return;
+    lock_acquire(&journal_lock);
+    while (committing || active > 0)
+        cond_wait(&journal_changed, &journal_lock);
+    if (enabled)
+        commit();
+    lock_release(&journal_lock);
+}
+
+/*! Commits any outstanding metadata and stops logging. */
+void journal_close(void) {
+    if (!enabled)
+        return;
+    lock_acquire(&journal_lock);
+    while (committing || active > 0)
+        cond_wait(&journal_changed, &journal_lock);
+    commit();
+    enabled = false;
+    lock_release(&journal_lock);
+}
+
+/*! Returns true if one more operation can start without the group
+    outgrowing the journal, counting the free map sectors that the commit
+    will have to log for it and for the operations before it.  The caller
+    must hold `journal_lock'. */
+static bool group_has_room(void) {
+    return (group_cnt + free_map_pending()
+            + (active + 1) * (JOURNAL_OP_MAX + JOURNAL_OP_ALLOC_MAX)
+            <= JOURNAL_BLOCKS);
+}
+
+/*! Starts an operation whose metadata updates must reach the disk together
+    or not at all.  Operations may nest; only the outermost counts. */
+void journal_begin(void) {
+    struct thread *t = thread_current();
+
+    if (!enabled || t->journal_depth++ > 0)
+        return;
+
+    lock_acquire(&journal_lock);
+    while (committing || !group_has_room()) {
+        if (!committing && active == 0)
+            commit();
+        else
+            cond_wait(&journal_changed, &journal_lock);
+    }
+    active++;
+    lock_release(&journal_lock);
+}
+
+/*! Ends an operation started by journal_begin().  The group is committed
+    once it is large enough and no operation is left in it. */
+void journal_end(void) {
+    struct thread *t = thread_current();
+
+    if (!enabled)
+        return;
+    ASSERT(t->journal_depth > 0);
+    if (--t->journal_depth > 0)
+        return;
+
+    lock_acquire(&journal_lock);
+    active--;
+    if (active == 0 && group_cnt >= JOURNAL_COMMIT_THRESHOLD)
+        commit();
+    cond_broadcast(&journal_changed, &journal_lock);
+    lock_release(&journal_lock);
+}
+
+/*! Adds SECTOR to the current group, if it is not there yet. */
+static void log_sector(block_sector_t sector) {
+    size_t i;
+
+    lock_acquire(&journal_lock);
+    for (i = 0; i < group_cnt; i++) {
+        if (group[i] == sector) {
+            lock_release(&journal_lock);
+            return;
+        }
+    }
+    if (group_cnt >= JOURNAL_BLOCKS)
+        PANIC("journal overflow");
+    if (group_cnt == 0)
+        group_start = timer_ticks();
+    cache_hold(sector);
+    group[group_cnt++] = sector;
+    lock_release(&journal_lock);
+}
+
+/*! Like cache_write_at(), for a metadata sector: the change reaches its home
+    location only after the commit that logs it. */
+void journal_write_at(block_sector_t sector, const void *buffer, size_t ofs,
+                      size_t size) {
+    if (enabled)
+        log_sector(sector);
+    cache_write_at(sector, buffer, ofs, size);
+}
+
+/*! Like cache_zero(), for a metadata sector. */
+void journal_zero(block_sector_t sector) {
+    if (enabled)
+        log_sector(sector);
+    cache_zero(sector);
+}
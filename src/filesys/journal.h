@@ -0,0 +1,27 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/*! Number of logged sectors one commit can hold. */
+#define JOURNAL_BLOCKS 32
+
+/*! Sectors reserved for the journal, starting at JOURNAL_SECTOR: a header
+    followed by JOURNAL_BLOCKS logged sector images. */
+#define JOURNAL_SIZE (1 + JOURNAL_BLOCKS)
+
+void journal_init(void);
+bool journal_set_crash(const char *point);
+void journal_create(void);
+void journal_open(void);
+void journal_close(void);
+void journal_commit(void);
+
+void journal_begin(void);
+void journal_end(void);
+void journal_write_at(block_sector_t, const void *, size_t ofs, size_t size);
+void journal_zero(block_sector_t);
+
+#endif /* filesys/journal.h */
@@ -358,6 +358,24 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the CNT bytes of B's file image that begin at byte
+   offset OFS to the same offset in FILE, stopping at the end of
+   the image.  Lets callers that track which parts of B changed
+   rewrite only those parts.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write_partial (const struct bitmap *b, struct file *file,
+                      size_t ofs, size_t cnt)
+{
+  size_t size = byte_cnt (b->bit_cnt);
+  if (ofs >= size)
+    return true;
+  if (cnt > size - ofs)
+    cnt = size - ofs;
+  return (file_write_at (file, (const uint8_t *) b->bits + ofs, cnt, ofs)
+          == (off_t) cnt);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -34,7 +34,18 @@ enum {
     SYS_MKDIR,                  /*!< Create a directory. */
     SYS_READDIR,                /*!< Reads a directory entry. */
     SYS_ISDIR,                  /*!< Tests if a fd represents a directory. */
-    SYS_INUMBER                 /*!< Returns the inode number for a fd. */
+    SYS_INUMBER,                /*!< Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_PREAD,                  /*!< Read from a file at an offset. */
+    SYS_PWRITE,                 /*!< Write to a file at an offset. */
+    SYS_READV,                  /*!< Read from a file into several buffers. */
+    SYS_WRITEV,                 /*!< Write several buffers to a file. */
+    SYS_SENDFILE,               /*!< Copy between files in the kernel. */
+    SYS_DUP2,                   /*!< Duplicate a file descriptor. */
+    SYS_IO_RING_ENTER,          /*!< Perform a batch of queued calls. */
+    SYS_FORK,                   /*!< Duplicate the current process. */
+    SYS_FSYNC                   /*!< Write changes to a file to disk. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -1,26 +1,80 @@
 /*! \file syscall.c
  *
  * User-space wrappers for invoking system calls through the standard UNIX
- * APIs.  Four macros are defined, syscall0(), syscall1(), syscall2(), and
- * syscall3(), to pass the corresponding number of arguments to the system
- * call being invoked.  The remaining functions are wrappers for standard
+ * APIs.  Five macros are defined, syscall0(), syscall1(), syscall2(),
+ * syscall3(), and syscall4(), to pass the corresponding number of arguments
+ * to the system call being invoked.  The remaining functions are wrappers for standard
  * UNIX operations, which simply use the syscall macros to invoke the
  * system call.
+ *
+ * The macros enter the kernel through syscall_trap, which points to one of
+ * two stubs: syscall_int_trap, which uses int $0x30 and always works, or
+ * syscall_sysenter_trap, which uses the faster SYSENTER instruction where
+ * the CPU has it.  _start() picks one with syscall_use_sysenter().
  */
 
 #include <syscall.h>
 #include "../syscall-nr.h"
 
+/*! Kernel entry stubs.  Each is called with the system call number and
+    arguments pushed just above its return address.  It pops the return
+    address into %edx, so that the kernel finds the number at the stack
+    pointer, and comes back there with the result in %eax.  %ecx and %edx
+    are clobbered. */
+void syscall_int_trap(void);
+void syscall_sysenter_trap(void);
+asm (".globl syscall_int_trap\n"
+     "syscall_int_trap:\n"
+     "    popl %edx\n"
+     "    int $0x30\n"
+     "    jmp *%edx\n"
+     ".globl syscall_sysenter_trap\n"
+     "syscall_sysenter_trap:\n"
+     "    popl %edx\n"
+     "    movl %esp, %ecx\n"
+     "    sysenter\n");
+
+/*! The stub the syscall macros call. */
+static void (*syscall_trap)(void) = syscall_int_trap;
+
+/*! CPUID leaf 1 EDX bit for SYSENTER and SYSEXIT. */
+#define CPUID_SEP (1u << 11)
+
+/*! Makes system calls enter the kernel through SYSENTER if USE is true and
+    the CPU supports it (the kernel sets it up under the same condition), or
+    through int $0x30 otherwise.  Returns true if SYSENTER is now in use. */
+bool syscall_use_sysenter(bool use) {
+    unsigned eax, ebx, ecx, edx;
+    unsigned family, model, stepping;
+
+    syscall_trap = syscall_int_trap;
+    if (!use)
+        return false;
+
+    /* Early Pentium Pros set the CPUID bit without implementing the
+       instructions. */
+    asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    family = (eax >> 8) & 0xf;
+    model = (eax >> 4) & 0xf;
+    stepping = eax & 0xf;
+    if ((edx & CPUID_SEP) == 0 || (family == 6 && model < 3 && stepping < 3))
+        return false;
+
+    syscall_trap = syscall_sysenter_trap;
+    return true;
+}
+
 /*! Invokes syscall NUMBER, passing no arguments, and returns the
     return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; call *%[trap]; addl $4, %%esp"   \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : [trap] "m" (syscall_trap),                     \
+                 [number] "i" (NUMBER)                          \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -30,11 +84,13 @@
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+            ("pushl %[arg0]; pushl %[number]; "                          \
+             "call *%[trap]; addl $8, %%esp"                             \
                : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
+               : [trap] "m" (syscall_trap),                              \
+                 [number] "i" (NUMBER),                                  \
                  [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
+               : "ecx", "edx", "memory");                                \
           retval;                                                        \
         })
 
@@ -45,12 +101,13 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; call *%[trap]; addl $12, %%esp"  \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
+               : [trap] "m" (syscall_trap),                     \
+                 [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -61,13 +118,34 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; call *%[trap]; addl $16, %%esp"  \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
+               : [trap] "m" (syscall_trap),                     \
+                 [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
                  [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
+        })
+
+/*! Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2, and
+    ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; call *%[trap]; "  \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [trap] "m" (syscall_trap),                     \
+                 [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -153,3 +231,39 @@ int inumber(int fd) {
     return syscall1(SYS_INUMBER, fd);
 }
 
+int pread(int fd, void *buffer, unsigned size, unsigned offset) {
+    return syscall4(SYS_PREAD, fd, buffer, size, offset);
+}
+
+int pwrite(int fd, const void *buffer, unsigned size, unsigned offset) {
+    return syscall4(SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int sendfile(int out_fd, int in_fd, unsigned offset, unsigned count) {
+    return syscall4(SYS_SENDFILE, out_fd, in_fd, offset, count);
+}
+
+int dup2(int oldfd, int newfd) {
+    return syscall2(SYS_DUP2, oldfd, newfd);
+}
+
+int io_ring_enter(struct io_ring *ring, unsigned to_submit) {
+    return syscall2(SYS_IO_RING_ENTER, ring, to_submit);
+}
+
+pid_t fork(void) {
+    return (pid_t) syscall0(SYS_FORK);
+}
+
+int fsync(int fd) {
+    return syscall1(SYS_FSYNC, fd);
+}
+
@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
 
 /*! Process identifier. */
@@ -15,6 +16,45 @@ typedef int mapid_t;
 /*! Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/*! One buffer of a readv() or writev() call. */
+struct iovec {
+    void *iov_base;             /*!< Start of the buffer. */
+    size_t iov_len;             /*!< Length of the buffer in bytes. */
+};
+
+/*! Most buffers accepted by one readv() or writev() call. */
+#define IOV_MAX 32
+
+/*! One operation queued on an io_ring.  OP is the number of the system
+    call to perform, one of SYS_READ, SYS_WRITE, SYS_SEEK, SYS_TELL,
+    SYS_OPEN, SYS_CLOSE, SYS_FILESIZE, SYS_PREAD and SYS_PWRITE, and ARGS are
+    its arguments in the order the call takes them. */
+struct io_sqe {
+    int op;                     /*!< System call number. */
+    unsigned args[4];           /*!< Arguments. */
+    unsigned user_data;         /*!< Passed through to the completion. */
+};
+
+/*! The completion of one io_sqe. */
+struct io_cqe {
+    unsigned user_data;         /*!< From the io_sqe. */
+    int result;                 /*!< What the system call returned. */
+};
+
+/*! A submission queue and a completion queue, in the program's own memory.
+    The program adds operations at SQ_TAIL and takes completions from
+    CQ_HEAD; io_ring_enter() advances SQ_HEAD and CQ_TAIL.  The indexes count
+    up freely and are taken modulo ENTRIES, which must be a power of 2. */
+struct io_ring {
+    unsigned entries;           /*!< Slots in each of SQES and CQES. */
+    unsigned sq_head;           /*!< Next operation to perform. */
+    unsigned sq_tail;           /*!< Where to queue the next operation. */
+    unsigned cq_head;           /*!< Next completion to take. */
+    unsigned cq_tail;           /*!< Where the next completion goes. */
+    struct io_sqe *sqes;        /*!< Submission queue. */
+    struct io_cqe *cqes;        /*!< Completion queue. */
+};
+
 /*! Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /*!< Successful execution. */
 #define EXIT_FAILURE 1          /*!< Unsuccessful execution. */
@@ -45,5 +85,19 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+int pread(int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite(int fd, const void *buffer, unsigned length, unsigned offset);
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
+int sendfile(int out_fd, int in_fd, unsigned offset, unsigned count);
+int dup2(int oldfd, int newfd);
+int io_ring_enter(struct io_ring *, unsigned to_submit);
+pid_t fork(void);
+int fsync(int fd);
+
+/* Choosing how system calls enter the kernel. */
+bool syscall_use_sysenter(bool use);
+
 #endif /* lib/user/syscall.h */
 
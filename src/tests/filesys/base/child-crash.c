@@ -0,0 +1,47 @@
+/* Child process for the crash tests.
+   Given "old", creates a file named "old" and exits, leaving the
+   kernel to shut down normally.  Given "new", creates a file
+   named "new" and calls fsync on it, during which a kernel run
+   with the -crash option stops the machine. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/crash.h"
+
+const char *test_name = "child-crash";
+
+static char buf[FILE_SIZE];
+
+static int
+create_file (const char *file_name, unsigned seed)
+{
+  int fd;
+
+  random_init (seed);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  return fd;
+}
+
+int
+main (int argc, const char *argv[]) 
+{
+  int fd;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  if (!strcmp (argv[1], "old"))
+    close (create_file ("old", 0));
+  else
+    {
+      fd = create_file ("new", 1);
+      CHECK (fsync (fd) == 0, "fsync \"new\"");
+      fail ("fsync returned without crashing");
+    }
+  return 0;
+}
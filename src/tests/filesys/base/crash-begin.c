@@ -0,0 +1,7 @@
+/* Checks the file system after a crash at the start of a journal
+   commit, before anything was written: the file created by the
+   previous boot must be intact, and the one the commit would
+   have created must not exist. */
+
+#define NEW_COMMITTED 0
+#include "tests/filesys/base/crash.inc"
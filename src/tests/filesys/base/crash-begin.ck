@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+common_checks ("first run", read_text_file ("$test-old.output"));
+my (@crash) = read_text_file ("$test-crash.output");
+common_checks ("crash run", @crash);
+fail "Crash run didn't crash\n" if !grep (/^Crashing\.\.\./, @crash);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(crash-begin) begin
+(crash-begin) open "old" for verification
+(crash-begin) close "old"
+(crash-begin) open "new" (must return -1)
+(crash-begin) end
+EOF
+pass;
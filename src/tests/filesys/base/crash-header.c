@@ -0,0 +1,7 @@
+/* Checks the file system after a crash just after a journal
+   commit wrote its header, before any of its sectors reached
+   home: replaying the journal must bring back the file the commit
+   created, along with the data fsync wrote before committing. */
+
+#define NEW_COMMITTED 1
+#include "tests/filesys/base/crash.inc"
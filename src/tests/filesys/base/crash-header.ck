@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+common_checks ("first run", read_text_file ("$test-old.output"));
+my (@crash) = read_text_file ("$test-crash.output");
+common_checks ("crash run", @crash);
+fail "Crash run didn't crash\n" if !grep (/^Crashing\.\.\./, @crash);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(crash-header) begin
+(crash-header) open "old" for verification
+(crash-header) close "old"
+(crash-header) open "new" for verification
+(crash-header) close "new"
+(crash-header) end
+EOF
+pass;
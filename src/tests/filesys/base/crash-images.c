@@ -0,0 +1,7 @@
+/* Checks the file system after a crash while a journal commit
+   was overwriting the previous commit's images: the previous
+   commit must already be at home, with none of the interrupted
+   commit's changes. */
+
+#define NEW_COMMITTED 0
+#include "tests/filesys/base/crash.inc"
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BASE_CRASH_H
+#define TESTS_FILESYS_BASE_CRASH_H
+
+/* "old" and "new" each hold FILE_SIZE random bytes, generated
+   from seeds 0 and 1 respectively. */
+#define FILE_SIZE 5000
+
+#endif /* tests/filesys/base/crash.h */
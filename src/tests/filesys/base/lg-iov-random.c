@@ -0,0 +1,70 @@
+/* Writes out the content of a fairly large file with writev,
+   gathering its blocks from a buffer in random order, then reads
+   it back with readv, scattering the blocks back to where they
+   came from, to verify that it was written properly. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 512
+#define TEST_SIZE (512 * 150)
+#define BLOCK_CNT (TEST_SIZE / BLOCK_SIZE)
+
+char buf[TEST_SIZE];
+char file_data[TEST_SIZE];
+int order[BLOCK_CNT];
+struct iovec iov[BLOCK_CNT];
+
+/* Points IOV at the blocks of BUFFER in the order given by
+   `order', and transfers them IOV_MAX at a time with XFER. */
+static void
+transfer (int fd, char *buffer,
+          int (*xfer) (int, const struct iovec *, int), const char *name) 
+{
+  size_t i;
+
+  for (i = 0; i < BLOCK_CNT; i++) 
+    {
+      iov[i].iov_base = buffer + BLOCK_SIZE * order[i];
+      iov[i].iov_len = BLOCK_SIZE;
+    }
+  for (i = 0; i < BLOCK_CNT; i += IOV_MAX) 
+    {
+      int cnt = BLOCK_CNT - i < IOV_MAX ? BLOCK_CNT - i : IOV_MAX;
+      if (xfer (fd, iov + i, cnt) != cnt * BLOCK_SIZE)
+        fail ("%s of %d blocks at block %zu failed", name, cnt, i);
+    }
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "bazzle";
+  int fd;
+  size_t i;
+
+  random_init (57);
+  random_bytes (buf, sizeof buf);
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    order[i] = i;
+  shuffle (order, BLOCK_CNT, sizeof *order);
+
+  CHECK (create (file_name, TEST_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  msg ("writev \"%s\" from blocks in random order", file_name);
+  transfer (fd, buf, writev, "writev");
+
+  msg ("readv \"%s\" into blocks in random order", file_name);
+  seek (fd, 0);
+  transfer (fd, file_data, readv, "readv");
+  compare_bytes (file_data, buf, TEST_SIZE, 0, file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
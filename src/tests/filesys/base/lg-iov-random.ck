@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-iov-random) begin
+(lg-iov-random) create "bazzle"
+(lg-iov-random) open "bazzle"
+(lg-iov-random) writev "bazzle" from blocks in random order
+(lg-iov-random) readv "bazzle" into blocks in random order
+(lg-iov-random) close "bazzle"
+(lg-iov-random) end
+EOF
+pass;
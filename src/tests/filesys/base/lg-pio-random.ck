@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-pio-random) begin
+(lg-pio-random) create "bazzle"
+(lg-pio-random) open "bazzle"
+(lg-pio-random) pwrite "bazzle" in random order
+(lg-pio-random) pread "bazzle" in random order
+(lg-pio-random) position of "bazzle" is unchanged
+(lg-pio-random) close "bazzle"
+(lg-pio-random) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Opens more files than fit in a small descriptor table, checks
+   that the lowest free descriptor is reused, then duplicates a
+   descriptor with dup2 and verifies that the two share a file
+   position and outlive each other. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FD_CNT 40
+#define TEST_SIZE 1024
+
+char buf[TEST_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "quux";
+  int fds[FD_CNT];
+  char block[TEST_SIZE / 2];
+  int fd, i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, TEST_SIZE) == TEST_SIZE,
+         "write %d bytes to \"%s\"", TEST_SIZE, file_name);
+  close (fd);
+
+  msg ("open \"%s\" %d times", file_name, FD_CNT);
+  for (i = 0; i < FD_CNT; i++)
+    {
+      fds[i] = open (file_name);
+      if (fds[i] < 2)
+        fail ("open #%d failed", i);
+      if (i > 0 && fds[i] != fds[i - 1] + 1)
+        fail ("open #%d returned %d, not the lowest free fd", i, fds[i]);
+    }
+
+  close (fds[FD_CNT / 2]);
+  CHECK (open (file_name) == fds[FD_CNT / 2], "reopen gets lowest free fd");
+
+  CHECK (dup2 (fds[0], 500) == 500, "dup2 %d onto 500", fds[0]);
+  CHECK (read (fds[0], block, sizeof block) == sizeof block,
+         "read through original fd");
+  compare_bytes (block, buf, sizeof block, 0, file_name);
+  CHECK (tell (500) == sizeof block, "duplicate shares the position");
+
+  close (fds[0]);
+  CHECK (read (500, block, sizeof block) == sizeof block,
+         "read through duplicate after closing original");
+  compare_bytes (block, buf + sizeof block, sizeof block, sizeof block,
+                 file_name);
+
+  CHECK (dup2 (fds[0], fds[1]) == -1, "dup2 of closed fd fails");
+  CHECK (dup2 (500, 1 << 20) == -1, "dup2 onto huge fd fails");
+
+  msg ("close all");
+  close (500);
+  for (i = 1; i < FD_CNT; i++)
+    close (fds[i]);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-dup2) begin
+(sm-dup2) create "quux"
+(sm-dup2) open "quux"
+(sm-dup2) write 1024 bytes to "quux"
+(sm-dup2) open "quux" 40 times
+(sm-dup2) reopen gets lowest free fd
+(sm-dup2) dup2 2 onto 500
+(sm-dup2) read through original fd
+(sm-dup2) duplicate shares the position
+(sm-dup2) read through duplicate after closing original
+(sm-dup2) dup2 of closed fd fails
+(sm-dup2) dup2 onto huge fd fails
+(sm-dup2) close all
+(sm-dup2) end
+EOF
+pass;
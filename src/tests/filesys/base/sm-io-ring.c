@@ -0,0 +1,89 @@
+/* Writes a file through an io_ring in one io_ring_enter call,
+   then seeks, reads it back and closes it in a second, checking
+   every completion. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 64
+#define BLOCK_CNT 16
+#define RING_SIZE 32
+
+static char buf[BLOCK_SIZE * BLOCK_CNT];
+static char readback[BLOCK_SIZE * BLOCK_CNT];
+static struct io_sqe sqes[RING_SIZE];
+static struct io_cqe cqes[RING_SIZE];
+static struct io_ring ring;
+
+/* Queues system call OP with arguments A0...A2 on the ring. */
+static void
+queue (int op, unsigned a0, unsigned a1, unsigned a2, unsigned user_data)
+{
+  struct io_sqe *sqe = &sqes[ring.sq_tail++ % RING_SIZE];
+  sqe->op = op;
+  sqe->args[0] = a0;
+  sqe->args[1] = a1;
+  sqe->args[2] = a2;
+  sqe->user_data = user_data;
+}
+
+/* Takes the next completion off the ring and checks that it is
+   for USER_DATA and returned RESULT. */
+static void
+reap (unsigned user_data, int result)
+{
+  struct io_cqe *cqe;
+
+  if (ring.cq_head == ring.cq_tail)
+    fail ("no completion for operation %u", user_data);
+  cqe = &cqes[ring.cq_head++ % RING_SIZE];
+  if (cqe->user_data != user_data)
+    fail ("completion for %u where %u expected", cqe->user_data, user_data);
+  if (cqe->result != result)
+    fail ("operation %u returned %d, not %d", user_data, cqe->result,
+          result);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "ringo";
+  int fd, i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  ring.entries = RING_SIZE;
+  ring.sqes = sqes;
+  ring.cqes = cqes;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    queue (SYS_WRITE, fd, (unsigned) (buf + i * BLOCK_SIZE), BLOCK_SIZE, i);
+  CHECK (io_ring_enter (&ring, BLOCK_CNT) == BLOCK_CNT,
+         "write %d blocks in one batch", BLOCK_CNT);
+  for (i = 0; i < BLOCK_CNT; i++)
+    reap (i, BLOCK_SIZE);
+
+  queue (SYS_SEEK, fd, 0, 0, 100);
+  for (i = 0; i < BLOCK_CNT; i++)
+    queue (SYS_READ, fd, (unsigned) (readback + i * BLOCK_SIZE), BLOCK_SIZE,
+           i);
+  queue (SYS_CLOSE, fd, 0, 0, 101);
+  CHECK (io_ring_enter (&ring, BLOCK_CNT + 2) == BLOCK_CNT + 2,
+         "seek, read %d blocks and close in one batch", BLOCK_CNT);
+  reap (100, 0);
+  for (i = 0; i < BLOCK_CNT; i++)
+    reap (i, BLOCK_SIZE);
+  reap (101, 0);
+  compare_bytes (readback, buf, sizeof buf, 0, file_name);
+
+  CHECK (ring.sq_head == ring.sq_tail && ring.cq_head == ring.cq_tail,
+         "ring is empty");
+}
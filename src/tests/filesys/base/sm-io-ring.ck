@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-io-ring) begin
+(sm-io-ring) create "ringo"
+(sm-io-ring) open "ringo"
+(sm-io-ring) write 16 blocks in one batch
+(sm-io-ring) seek, read 16 blocks and close in one batch
+(sm-io-ring) ring is empty
+(sm-io-ring) end
+EOF
+pass;
@@ -0,0 +1,69 @@
+/* Copies part of a file into another with sendfile, checking
+   that the data lands at the output's position while the input's
+   position is left alone, then sends a file to the console and
+   verifies that bad descriptors and offsets are rejected. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 1024
+#define COPY_OFS 256
+#define COPY_SIZE 512
+
+char buf[TEST_SIZE];
+
+static int
+create_and_open (const char *file_name, const void *data, int size)
+{
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  if (size > 0 && write (fd, data, size) != size)
+    fail ("write %d bytes to \"%s\"", size, file_name);
+  return fd;
+}
+
+void
+test_main (void) 
+{
+  const char *greeting = "(sm-sendfile) sent to the console\n";
+  char block[COPY_SIZE];
+  int in_fd, out_fd, con_fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  in_fd = create_and_open ("in", buf, TEST_SIZE);
+  out_fd = create_and_open ("out", NULL, 0);
+  seek (in_fd, 100);
+
+  CHECK (sendfile (out_fd, in_fd, COPY_OFS, COPY_SIZE) == COPY_SIZE,
+         "sendfile %d bytes at offset %d", COPY_SIZE, COPY_OFS);
+  CHECK (tell (in_fd) == 100, "input position is unchanged");
+  CHECK (tell (out_fd) == COPY_SIZE, "output position advanced");
+  CHECK (sendfile (out_fd, in_fd, TEST_SIZE - 24, 100) == 24,
+         "sendfile stops at end of input");
+
+  seek (out_fd, 0);
+  CHECK (read (out_fd, block, COPY_SIZE) == COPY_SIZE, "read \"out\"");
+  compare_bytes (block, buf + COPY_OFS, COPY_SIZE, 0, "out");
+
+  con_fd = create_and_open ("con", greeting, strlen (greeting));
+  msg ("sendfile to the console");
+  if (sendfile (1, con_fd, 0, strlen (greeting)) != (int) strlen (greeting))
+    fail ("sendfile to the console");
+
+  CHECK (sendfile (out_fd, 500, 0, COPY_SIZE) == -1,
+         "sendfile from bad fd fails");
+  CHECK (sendfile (out_fd, in_fd, (unsigned) -1, COPY_SIZE) == -1,
+         "sendfile at negative offset fails");
+
+  msg ("close all");
+  close (con_fd);
+  close (out_fd);
+  close (in_fd);
+}
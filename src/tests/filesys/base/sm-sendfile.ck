@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-sendfile) begin
+(sm-sendfile) create "in"
+(sm-sendfile) open "in"
+(sm-sendfile) create "out"
+(sm-sendfile) open "out"
+(sm-sendfile) sendfile 512 bytes at offset 256
+(sm-sendfile) input position is unchanged
+(sm-sendfile) output position advanced
+(sm-sendfile) sendfile stops at end of input
+(sm-sendfile) read "out"
+(sm-sendfile) create "con"
+(sm-sendfile) open "con"
+(sm-sendfile) sendfile to the console
+(sm-sendfile) sent to the console
+(sm-sendfile) sendfile from bad fd fails
+(sm-sendfile) sendfile at negative offset fails
+(sm-sendfile) close all
+(sm-sendfile) end
+EOF
+pass;
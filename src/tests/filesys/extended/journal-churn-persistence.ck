@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs) = {};
+for (my $i = 0; $i < 32; $i += 2) {
+    $fs->{"j$i"} = ["rewritten $i"];
+}
+check_archive ($fs);
+pass;
@@ -0,0 +1,60 @@
+/* Creates a batch of small files, removes every other one
+   and rewrites the rest, so that a long run of metadata updates
+   goes through the journal over several commits.  The
+   persistence check then verifies that exactly the surviving
+   files, with their final contents, are there after the file
+   system is mounted again. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 32
+
+static void
+write_file (const char *name, const char *contents)
+{
+  int size = strlen (contents);
+  int fd = open (name);
+
+  if (fd < 2)
+    fail ("open \"%s\"", name);
+  if (write (fd, contents, size) != size)
+    fail ("write \"%s\"", name);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  char name[16], contents[32];
+  int i;
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "j%d", i);
+      snprintf (contents, sizeof contents, "file %d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+      write_file (name, contents);
+    }
+
+  msg ("remove odd-numbered files");
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "j%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+
+  msg ("rewrite even-numbered files");
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "j%d", i);
+      snprintf (contents, sizeof contents, "rewritten %d", i);
+      write_file (name, contents);
+    }
+}
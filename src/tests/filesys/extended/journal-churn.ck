@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(journal-churn) begin
+(journal-churn) create 32 files
+(journal-churn) remove odd-numbered files
+(journal-churn) rewrite even-numbered files
+(journal-churn) end
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Fills 1 MB of memory, forks, and has the child check that it
+   sees the same contents and then overwrite them.  Verifies that
+   the parent's copy is untouched by the child's writes, and that
+   the parent can still write to its pages once the child is
+   gone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+
+static char buf[SIZE];
+
+static void
+check (char value, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != value)
+      fail ("%s: byte %zu != %#x", who, i, value);
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+
+  msg ("initialize");
+  memset (buf, 0x5a, sizeof buf);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      check (0x5a, "child");
+      memset (buf, 0xa5, sizeof buf);
+      check ((char) 0xa5, "child");
+      exit (81);
+    }
+  CHECK (pid > 0, "fork");
+  CHECK (wait (pid) == 81, "wait for child");
+
+  msg ("parent's copy is unchanged");
+  check (0x5a, "parent");
+
+  msg ("write in parent");
+  memset (buf, 0x3c, sizeof buf);
+  check (0x3c, "parent");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) initialize
+(page-fork) fork
+(page-fork) wait for child
+(page-fork) parent's copy is unchanged
+(page-fork) write in parent
+(page-fork) end
+EOF
+pass;
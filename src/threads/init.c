@@ -45,6 +45,7 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
 
 #endif
 
@@ -140,6 +141,7 @@ int main(void) {
 
     /* Initialize swap table. */
     swap_init();
+    frame_pageout_init();
 
     printf("Boot complete.\n");
 
@@ -249,6 +251,10 @@ static char ** parse_options(char **argv) {
             filesys_bdev_name = value;
         else if (!strcmp(name, "-scratch"))
             scratch_bdev_name = value;
+        else if (!strcmp(name, "-crash")) {
+            if (value == NULL || !journal_set_crash(value))
+                PANIC("-crash must be begin, images or header");
+        }
 #ifdef VM
         else if (!strcmp(name, "-swap"))
             swap_bdev_name = value;
@@ -369,6 +375,7 @@ static void usage(void) {
            "  -f                 Format file system device during startup.\n"
            "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
            "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+           "  -crash=POINT       Crash at POINT of the first journal commit.\n"
 #ifdef VM
            "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
@@ -30,6 +31,7 @@ static struct pool kernel_pool, user_pool;
 
 static void init_pool(struct pool *, void *base, size_t page_cnt,
                       const char *name);
+static void adjust_free_cnt(struct pool *, int delta);
 
 /*! Initializes the page allocator.  At most USER_PAGE_LIMIT
     pages are put into the user pool. */
@@ -58,7 +60,8 @@ void palloc_init(size_t user_page_limit) {
     FLAGS, in which case the kernel panics.
 
     If too few pages are available and PAL_USER is set, then first try to
-    evict pages before returning NULL or panicing.
+    evict pages before returning NULL or panicing, unless PAL_NOEVICT is
+    also set.
 
     If PAL_USER is set, then the frame table entries corresponding to the
     new pages have their kernal_vaddr fields set, and all other fields
@@ -73,13 +76,15 @@ void * palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
 
     lock_acquire(&pool->lock);
     page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
+    if (page_idx != BITMAP_ERROR)
+        adjust_free_cnt(pool, -(int) page_cnt);
     lock_release(&pool->lock);
 
     if (page_idx != BITMAP_ERROR) {
         pages = pool->base + PGSIZE * page_idx;
     }
     else {
-        if (flags & PAL_USER) {
+        if ((flags & PAL_USER) && !(flags & PAL_NOEVICT)) {
             pages = frame_evict(page_cnt);
             ASSERT(pages != NULL);
         }
@@ -99,6 +104,8 @@ void * palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
             ft_init_entries(pages, page_cnt);
         }
     }
+    if (flags & PAL_USER)
+        frame_pageout_wake();
 
     return pages;
 }
@@ -138,6 +145,7 @@ void palloc_free_multiple(void *pages, size_t page_cnt) {
 
     ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
     bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+    adjust_free_cnt(pool, page_cnt);
 
     if (pool == &user_pool) {
         ft_deinit_entries(pages, page_cnt);
@@ -167,6 +175,15 @@ static void init_pool(struct pool *p, void *base, size_t page_cnt,
     lock_init(&p->lock);
     p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
     p->base = base + bm_pages * PGSIZE;
+    p->free_cnt = page_cnt;
+}
+
+/*! Adds DELTA to P's count of free pages.  Pages are freed without
+    holding the pool's lock, so the count is updated atomically. */
+static void adjust_free_cnt(struct pool *p, int delta) {
+    enum intr_level old_level = intr_disable();
+    p->free_cnt += delta;
+    intr_set_level(old_level);
 }
 
 /*! Returns true if PAGE was allocated from POOL, false otherwise. */
@@ -9,7 +9,8 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_NOEVICT = 010           /* Fail rather than evict a user page. */
   };
 
 /*! A memory pool. */
@@ -17,6 +18,7 @@ struct pool {
     struct lock lock;                   /*!< Mutual exclusion. */
     struct bitmap *used_map;            /*!< Bitmap of free pages. */
     uint8_t *base;                      /*!< Base of pool. */
+    size_t free_cnt;                    /*!< Number of free pages. */
 };
 
 bool page_from_pool(const struct pool *, void *);
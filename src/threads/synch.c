@@ -283,6 +283,7 @@ int lock_get_priority(struct lock *lock) {
 struct semaphore_elem {
     struct list_elem elem;              /*!< List element. */
     struct semaphore semaphore;         /*!< This semaphore. */
+    struct thread *thread;              /*!< Thread waiting on it. */
 };
 
 /*! Initializes condition variable COND.  A condition variable
@@ -323,6 +324,7 @@ void cond_wait(struct condition *cond, struct lock *lock) {
     ASSERT(lock_held_by_current_thread(lock));
 
     sema_init(&waiter.semaphore, 0);
+    waiter.thread = thread_current();
     list_push_back(&cond->waiters, &waiter.elem);
     lock_release(lock);
     sema_down(&waiter.semaphore);
@@ -343,24 +345,20 @@ void cond_signal(struct condition *cond, struct lock *lock UNUSED) {
     ASSERT(lock_held_by_current_thread (lock));
 
     if (!list_empty(&cond->waiters)) {
-        // Iterate through the list of semaphores. Each semaphore has exactly
-        // one thread waiting on it. Call seam_up() on a semaphore whose
+        // Iterate through the list of semaphores. Each semaphore belongs to
+        // exactly one waiting thread. Call seam_up() on a semaphore whose
         // waiting thread is of highest priority.
+        // The waiting thread is recorded in the semaphore_elem, because it
+        // may not have reached sema_down() yet if it was preempted right
+        // after releasing the lock in cond_wait().
         struct list_elem *e = list_begin(&cond->waiters);
         struct semaphore_elem *s = list_entry(e, struct semaphore_elem, elem);
-        ASSERT(list_size(&s->semaphore.waiters) == 1);
-        int max_priority_seen = thread_get_other_priority(
-                list_entry(list_begin(&s->semaphore.waiters),
-                           struct thread,
-                           elem));
+        int max_priority_seen = thread_get_other_priority(s->thread);
         struct list_elem *e_for_max_priority_sema_seen = e;
         for (e = list_next(e); e != list_end(&cond->waiters);
              e = list_next(e)) {
             s = list_entry(e, struct semaphore_elem, elem);
-            int priority = thread_get_other_priority(
-                    list_entry(list_begin(&s->semaphore.waiters),
-                               struct thread,
-                               elem));
+            int priority = thread_get_other_priority(s->thread);
             if (priority > max_priority_seen) {
                 max_priority_seen = priority;
                 e_for_max_priority_sema_seen = e;
@@ -386,3 +384,56 @@ void cond_broadcast(struct condition *cond, struct lock *lock) {
         cond_signal(cond, lock);
 }
 
+/*! Initializes RW as an unheld readers-writer lock. */
+void rwlock_init(struct rwlock *rw) {
+    ASSERT(rw != NULL);
+
+    lock_init(&rw->lock);
+    cond_init(&rw->readers_ok);
+    cond_init(&rw->writers_ok);
+    rw->readers = 0;
+    rw->writer = false;
+    rw->waiting_writers = 0;
+}
+
+/*! Acquires RW for reading, sleeping while a writer holds it or is waiting
+    for it. */
+void rwlock_acquire_read(struct rwlock *rw) {
+    lock_acquire(&rw->lock);
+    while (rw->writer || rw->waiting_writers > 0)
+        cond_wait(&rw->readers_ok, &rw->lock);
+    rw->readers++;
+    lock_release(&rw->lock);
+}
+
+/*! Releases RW, which the current thread holds for reading. */
+void rwlock_release_read(struct rwlock *rw) {
+    lock_acquire(&rw->lock);
+    ASSERT(rw->readers > 0);
+    if (--rw->readers == 0)
+        cond_signal(&rw->writers_ok, &rw->lock);
+    lock_release(&rw->lock);
+}
+
+/*! Acquires RW for writing, sleeping until no reader or writer holds it. */
+void rwlock_acquire_write(struct rwlock *rw) {
+    lock_acquire(&rw->lock);
+    rw->waiting_writers++;
+    while (rw->writer || rw->readers > 0)
+        cond_wait(&rw->writers_ok, &rw->lock);
+    rw->waiting_writers--;
+    rw->writer = true;
+    lock_release(&rw->lock);
+}
+
+/*! Releases RW, which the current thread holds for writing. */
+void rwlock_release_write(struct rwlock *rw) {
+    lock_acquire(&rw->lock);
+    ASSERT(rw->writer);
+    rw->writer = false;
+    if (rw->waiting_writers > 0)
+        cond_signal(&rw->writers_ok, &rw->lock);
+    else
+        cond_broadcast(&rw->readers_ok, &rw->lock);
+    lock_release(&rw->lock);
+}
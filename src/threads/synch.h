@@ -48,6 +48,24 @@ void cond_wait(struct condition *, struct lock *);
 void cond_signal(struct condition *, struct lock *);
 void cond_broadcast(struct condition *, struct lock *);
 
+/*! Readers-writer lock.  Held either by any number of readers or by a
+    single writer.  Waiting writers hold off new readers, so that a steady
+    stream of readers cannot starve a writer. */
+struct rwlock {
+    struct lock lock;               /*!< Protects the members below. */
+    struct condition readers_ok;    /*!< Signaled when readers may enter. */
+    struct condition writers_ok;    /*!< Signaled when a writer may enter. */
+    int readers;                    /*!< Number of readers holding it. */
+    bool writer;                    /*!< True if a writer holds it. */
+    int waiting_writers;            /*!< Number of writers waiting. */
+};
+
+void rwlock_init(struct rwlock *);
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+
 /*! Optimization barrier.
 
    The compiler will not reorder operations across an
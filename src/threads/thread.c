@@ -13,7 +13,6 @@
 #include "threads/vaddr.h"
 #include "devices/timer.h"
 #include "threads/fixed-point.h"
-#include "filesys/file.h"
 
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -356,13 +355,7 @@ void thread_exit(void) {
 #endif
 
     struct thread * cur = thread_current();
-    int i;
-    for (i = 0; i < MAX_FILE_DESCRIPTORS; i++) {
-        if (cur->open_files[i] != NULL) {
-            file_close(cur->open_files[i]);
-            cur->open_files[i] = NULL;
-        }
-    }
+    fd_table_destroy(&cur->fds);
 
     /* Remove thread from all threads list, set our status to dying,
        and schedule another process.  That process will destroy us
@@ -617,19 +610,15 @@ static void init_thread(struct thread *t, const char *name, int priority,
     t->status = THREAD_BLOCKED;
     t->exit_status = 0;
     t->executable = NULL;
+    t->journal_depth = 0;
     strlcpy(t->name, name, sizeof t->name);
     t->stack = (uint8_t *) t + PGSIZE;
     t->priority = priority;
     t->nice = nice;
     t->recent_cpu = recent_cpu;
-    t->pin_begin_page = NULL;
-    t->pin_end_page = NULL;
     t->magic = THREAD_MAGIC;
 
-    int i;
-    for (i = 0; i < MAX_FILE_DESCRIPTORS; i++) {
-        t->open_files[i] = NULL;
-    }
+    fd_table_init(&t->fds);
 
     list_init(&t->locks_held);
     list_init(&t->child_list);
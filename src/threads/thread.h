@@ -11,6 +11,7 @@
 #include <hash.h>
 #include <stdint.h>
 #include "threads/synch.h"
+#include "userprog/fdtable.h"
 
 /*! States in a thread's life cycle. */
 enum thread_status {
@@ -21,8 +22,6 @@ enum thread_status {
     THREAD_DYING        /*!< About to be destroyed. */
 };
 
-#define MAX_FILE_DESCRIPTORS 16
-
 /*! Thread identifier type.
     You can redefine this to whatever type you like. */
 typedef int tid_t;
@@ -130,6 +129,9 @@ struct thread {
     /*! The executable file for this process, if applicable. */
     struct file * executable;
 
+    /*! Nesting depth of file system journal operations. */
+    int journal_depth;
+
 #ifdef USERPROG
     /*! Owned by userprog/process.c. */
     /**@{*/
@@ -138,19 +140,14 @@ struct thread {
 
     // Supplemental page table
     struct hash spt;
+
+    /*! User stack pointer on entry to the current system call, for page
+        faults taken in the kernel on the process's behalf. */
+    void *user_esp;
 #endif
 
-    /* Fixed-size array of pointers to open file structs */
-    struct file *open_files[16];
-
-    // Page-aligned pointers or NULL pointers
-    // If both are not NULL, then they indicate to the page fault handler that
-    // user memory accessses that fall in the pages between pin_begin_page
-    // and pin_end_page, inclusive, should be pinned to physical memory
-    // after being loaded into physical memory and before being mapped to
-    // userspace.
-    unsigned char * pin_begin_page;
-    unsigned char * pin_end_page;
+    /*! Open files, by descriptor. */
+    struct fd_table fds;
 
     /*! Owned by thread.c. */
     /**@{*/
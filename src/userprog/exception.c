@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
+#include "userprog/uaccess.h"
 #include "userprog/pagedir.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -119,8 +120,7 @@ static void kill(struct intr_frame *f) {
 static void page_fault(struct intr_frame *f) {
     bool not_present;  /* True: not-present page, false: writing r/o page. */
     bool write;        /* True: access was write, false: access was read. */
-    // TODO(agf)
-    // bool user;         /* True: access by user, false: access by kernel. */
+    bool user;         /* True: access by user, false: access by kernel. */
     void *fault_addr;  /* Fault address. */
 
     /* Obtain faulting address, the virtual address that was accessed to cause
@@ -139,23 +139,7 @@ static void page_fault(struct intr_frame *f) {
     /* Determine cause. */
     not_present = (f->error_code & PF_P) == 0;
     write = (f->error_code & PF_W) != 0;
-    // TODO(agf)
-    // user = (f->error_code & PF_U) != 0;
-
-    struct thread * cur_thread = thread_current();
-    bool pin = false;
-    if (cur_thread->pin_begin_page != NULL) {
-        ASSERT(cur_thread->pin_end_page != NULL);
-        ASSERT(pg_round_down(cur_thread->pin_begin_page) ==
-               cur_thread->pin_begin_page);
-        ASSERT(pg_round_down(cur_thread->pin_end_page) ==
-               cur_thread->pin_end_page);
-        unsigned char * round_fault_addr = pg_round_down(fault_addr);
-        if (round_fault_addr >= cur_thread->pin_begin_page &&
-            round_fault_addr <= cur_thread->pin_end_page) {
-            pin = true;
-        }
-    }
+    user = (f->error_code & PF_U) != 0;
 
     // Load from Supplemental Page Table, if possible
     if (not_present) {
@@ -165,60 +149,44 @@ static void page_fault(struct intr_frame *f) {
             // But interrupt handlers should not wait on locks :(
             // Instead, pinning something might provide the answer...
             ASSERT(spte->key.addr == pg_round_down(fault_addr));
-            ASSERT(spte->trd == cur_thread);
-            if (spte->file != NULL && (!write || spte->writable)) {
-                // We were trying to read from an executable file.
-                // We weren't trying to write to a read-only page, and we
-                // successfully loaded that page into memory from file.
-                // TODO(agf): load_page_from_spte() will only work the first
-                // time that an executable page gets loaded.
-                // TODO(agf): Rename load_page_from_spte() to indicate that
-                // it is only for executables.
-                if (load_page_from_spte(spte, pin)) {
-                    return;
-                }
-            }
-            if (spte->swap_page_number != -1) {
-                // Obtain a free page and map it into memory.
-                // pagedir_set_page() updates the frame table entry.
-                uint8_t *kpage = palloc_get_page(PAL_USER);
-                if (pin) {
-                    bool acquired = lock_try_acquire(&ft_lookup(kpage)->lock);
-                    ASSERT(acquired);
-                }
-                // TODO(agf): Make the page read-only if needed
-                ASSERT(spte->trd->pagedir != NULL);
-                bool result = pagedir_set_page(spte->trd->pagedir,
-                                               spte->key.addr, kpage, true);
-                ASSERT(result);
-                // Read page from swap
-                // TODO(agf): Shouldn't need this
-                // Perhaps pin the page at key.addr instead
-                eviction_lock_acquire();
-                swap_read_page(spte->swap_page_number, spte->key.addr);
-                eviction_lock_release();
-                // Free the swap slot
-                mark_slot_unused(spte->swap_page_number);
-                // TODO(agf): Update the SPT entry?
+            ASSERT(spte->trd == thread_current());
+            if (spt_entry_load(spte, write, false)) {
                 return;
             }
         }
     }
 
+    // A write to a page that is read-only only because it is shared
+    // copy-on-write with a process forked from this one, or with the
+    // process this one was forked from, gets a copy of its own
+    if (!not_present && write && is_user_vaddr(fault_addr)) {
+        struct spt_entry * spte = spt_entry_lookup(fault_addr, NULL);
+        if (spte == NULL || spte->writable) {
+            spt_break_cow(pg_round_down(fault_addr), false);
+            return;
+        }
+    }
+
     // Grow the stack if the faulting address is a user address that looks like
-    // a stack access.
+    // a stack access.  A fault taken in the kernel has no user esp in its
+    // frame, so use the one saved on system call entry.
+    void *esp = user ? f->esp : thread_current()->user_esp;
     if (fault_addr != NULL && is_user_vaddr(fault_addr) &&
-        fault_addr >= (void *)((uint8_t *) f->esp - 32) &&
+        fault_addr >= (void *)((uint8_t *) esp - 32) &&
         fault_addr >= PHYS_BASE - 2048 * PGSIZE) {
-        if (allocate_and_install_blank_page(fault_addr, pin)) {
+        if (allocate_and_install_blank_page(fault_addr, false)) {
             return;
         }
     }
 
-    // Invalid user pointer accesses in syscalls should be handled by
-    // inspecting the pointers before dereferencing them. But, we also have to
-    // handle cases when e.g. a NULL function pointer is called, or a function
-    // pointer to kernel code is called from user code.
+    // A kernel access to user memory through copy_from_user() and friends
+    // fails gracefully; the caller sees the error.
+    if (!user && is_user_vaddr(fault_addr) && uaccess_fixup(f)) {
+        return;
+    }
+
+    // Anything else is a bad access by the process itself, or by a system
+    // call that dereferenced a user pointer directly.
     f->eax = -1;
     sys_exit_helper(-1);
 }
@@ -0,0 +1,154 @@
+#include "userprog/fdtable.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+
+/*! Initializes T as an empty table that uses only its inline storage. */
+void fd_table_init(struct fd_table *t) {
+    ASSERT(bitmap_buf_size(FD_INLINE_CNT) <= sizeof t->inline_used);
+
+    memset(t->inline_files, 0, sizeof t->inline_files);
+    t->files = t->inline_files;
+    t->used = bitmap_create_in_buf(FD_INLINE_CNT, t->inline_used,
+                                   sizeof t->inline_used);
+    t->size = FD_INLINE_CNT;
+    t->hint = 0;
+}
+
+/*! Closes every file in T and frees any memory T allocated. */
+void fd_table_destroy(struct fd_table *t) {
+    int i;
+
+    for (i = 0; i < t->size; i++) {
+        if (t->files[i] != NULL) {
+            file_close(t->files[i]);
+            t->files[i] = NULL;
+        }
+    }
+    if (t->files != t->inline_files) {
+        free(t->files);
+        bitmap_destroy(t->used);
+    }
+    fd_table_init(t);
+}
+
+/*! Grows T, doubling its size until it has at least MIN_SIZE entries.
+    Returns false if MIN_SIZE is over FD_MAX or memory is short. */
+static bool grow(struct fd_table *t, int min_size) {
+    struct file **files;
+    struct bitmap *used;
+    int size, i;
+
+    if (min_size > FD_MAX)
+        return false;
+    for (size = t->size; size < min_size; size *= 2)
+        continue;
+    if (size > FD_MAX)
+        size = FD_MAX;
+
+    files = malloc(size * sizeof *files);
+    used = bitmap_create(size);
+    if (files == NULL || used == NULL) {
+        free(files);
+        if (used != NULL)
+            bitmap_destroy(used);
+        return false;
+    }
+    memcpy(files, t->files, t->size * sizeof *files);
+    memset(files + t->size, 0, (size - t->size) * sizeof *files);
+    for (i = 0; i < t->size; i++)
+        bitmap_set(used, i, bitmap_test(t->used, i));
+
+    if (t->files != t->inline_files) {
+        free(t->files);
+        bitmap_destroy(t->used);
+    }
+    t->files = files;
+    t->used = used;
+    t->size = size;
+    return true;
+}
+
+/*! Adds FILE to T under the lowest free descriptor and returns it, or -1 if
+    T is full. */
+int fd_table_install(struct fd_table *t, struct file *file) {
+    size_t idx;
+
+    ASSERT(file != NULL);
+
+    idx = bitmap_scan(t->used, t->hint, 1, false);
+    if (idx == BITMAP_ERROR) {
+        idx = t->size;
+        if (!grow(t, idx + 1))
+            return -1;
+    }
+    t->files[idx] = file;
+    bitmap_mark(t->used, idx);
+    t->hint = idx + 1;
+    return idx + FD_FIRST;
+}
+
+/*! Returns the file open as FD in T, or a null pointer if there is none. */
+struct file * fd_table_get(const struct fd_table *t, int fd) {
+    int idx = fd - FD_FIRST;
+
+    if (idx < 0 || idx >= t->size)
+        return NULL;
+    return t->files[idx];
+}
+
+/*! Closes FD in T.  The file itself is closed once no other descriptor
+    shares it.  Returns false if FD was not open. */
+bool fd_table_close(struct fd_table *t, int fd) {
+    struct file *file = fd_table_get(t, fd);
+    int idx = fd - FD_FIRST;
+
+    if (file == NULL)
+        return false;
+    t->files[idx] = NULL;
+    bitmap_reset(t->used, idx);
+    if (idx < t->hint)
+        t->hint = idx;
+    file_close(file);
+    return true;
+}
+
+/*! Makes NEWFD in T refer to the same open file as OLDFD, closing whatever
+    NEWFD referred to first.  The two descriptors then share a position.
+    Returns NEWFD, or -1 if OLDFD is not open or NEWFD is out of range. */
+int fd_table_dup2(struct fd_table *t, int oldfd, int newfd) {
+    struct file *file = fd_table_get(t, oldfd);
+    int idx = newfd - FD_FIRST;
+
+    if (file == NULL || idx < 0 || idx >= FD_MAX)
+        return -1;
+    if (oldfd == newfd)
+        return newfd;
+    if (idx >= t->size && !grow(t, idx + 1))
+        return -1;
+
+    if (t->files[idx] != NULL)
+        file_close(t->files[idx]);
+    t->files[idx] = file_dup(file);
+    bitmap_mark(t->used, idx);
+    return newfd;
+}
+
+/*! Fills DST, which must be empty, with the descriptors of SRC, for a forked
+    child.  Each descriptor refers to the same open file as in SRC, so parent
+    and child share its position.  Returns false if memory is short. */
+bool fd_table_clone(struct fd_table *dst, const struct fd_table *src) {
+    int i;
+
+    if (src->size > dst->size && !grow(dst, src->size))
+        return false;
+    for (i = 0; i < src->size; i++) {
+        if (src->files[i] != NULL) {
+            dst->files[i] = file_dup(src->files[i]);
+            bitmap_mark(dst->used, i);
+        }
+    }
+    dst->hint = src->hint;
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <bitmap.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct file;
+
+/*! First descriptor that names an open file; 0 and 1 are the console. */
+#define FD_FIRST 2
+
+/*! Most open files a process may have at once. */
+#define FD_MAX 1024
+
+/*! Open files a table holds before it has to allocate.  Most processes never
+    get past this, so their table lives entirely inside `struct thread'. */
+#define FD_INLINE_CNT 16
+
+/*! A process's open files, indexed by descriptor minus FD_FIRST.  An entry
+    may be shared with other descriptors, through fd_table_dup2(). */
+struct fd_table {
+    struct file **files;                /*!< Open files, or null. */
+    struct bitmap *used;                /*!< Which entries of FILES are set. */
+    int size;                           /*!< Number of entries in FILES. */
+    int hint;                           /*!< No free entry below this. */
+
+    /*! Storage for FILES and USED until the table first grows. */
+    /**@{*/
+    struct file *inline_files[FD_INLINE_CNT];
+    uint32_t inline_used[4];
+    /**@}*/
+};
+
+void fd_table_init(struct fd_table *);
+void fd_table_destroy(struct fd_table *);
+
+int fd_table_install(struct fd_table *, struct file *);
+struct file *fd_table_get(const struct fd_table *, int fd);
+bool fd_table_close(struct fd_table *, int fd);
+int fd_table_dup2(struct fd_table *, int oldfd, int newfd);
+bool fd_table_clone(struct fd_table *dst, const struct fd_table *src);
+
+#endif /* userprog/fdtable.h */
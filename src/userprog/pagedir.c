@@ -26,7 +26,9 @@ uint32_t * pagedir_create(void) {
     return pd;
 }
 
-/*! Destroys page directory PD, freeing all the pages it references. */
+/*! Destroys page directory PD, which must belong to the current process,
+    freeing all the pages it references.  A shared frame is only freed once
+    no other process maps it either. */
 void pagedir_destroy(uint32_t *pd) {
     uint32_t *pde;
 
@@ -40,8 +42,11 @@ void pagedir_destroy(uint32_t *pd) {
         uint32_t *pte;
 
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++) {
-            if (*pte & PTE_P)
-                palloc_free_page(pte_get_page(*pte));
+            if (*pte & PTE_P) {
+                void *upage = (void *) (((pde - pd) << PDSHIFT) |
+                                        ((pte - pt) << PTSHIFT));
+                ft_free_user_page(pte_get_page(*pte), upage);
+            }
         }
         palloc_free_page(pt);
     }
@@ -143,6 +148,41 @@ void pagedir_clear_page(uint32_t *pd, void *upage) {
     }
 }
 
+/*! Makes the mapping of user page UPAGE in PD writable or read-only, per
+    WRITABLE.  Does nothing if UPAGE is not mapped. */
+void pagedir_set_writable(uint32_t *pd, const void *upage, bool writable) {
+    uint32_t *pte = lookup_page(pd, upage, false);
+    if (pte != NULL && (*pte & PTE_P) != 0) {
+        if (writable) {
+            *pte |= PTE_W;
+        }
+        else if ((*pte & PTE_W) != 0) {
+            *pte &= ~(uint32_t) PTE_W;
+            invalidate_pagedir(pd);
+        }
+    }
+}
+
+/*! Calls FUNC with AUX for every user page mapped in PD, passing the page's
+    user virtual address and the kernel virtual address of its frame. */
+void pagedir_for_each(uint32_t *pd, pagedir_page_func *func, void *aux) {
+    uint32_t *pde;
+
+    for (pde = pd; pde < pd + pd_no(PHYS_BASE); pde++)
+    if (*pde & PTE_P) {
+        uint32_t *pt = pde_get_pt(*pde);
+        uint32_t *pte;
+
+        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++) {
+            if (*pte & PTE_P) {
+                void *upage = (void *) (((pde - pd) << PDSHIFT) |
+                                        ((pte - pt) << PTSHIFT));
+                func(upage, pte_get_page(*pte), aux);
+            }
+        }
+    }
+}
+
 /*! Returns true if the PTE for virtual page VPAGE in PD is dirty, that is, if
     the page has been modified since the PTE was installed.
     Returns false if PD contains no PTE for VPAGE. */
@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*! Function called by pagedir_for_each() for each mapped user page. */
+typedef void pagedir_page_func(void *upage, void *kpage, void *aux);
+
 uint32_t *pagedir_create(void);
 void pagedir_destroy(uint32_t *pd);
 bool pagedir_set_page(uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -13,6 +16,8 @@ bool pagedir_is_dirty(uint32_t *pd, const void *upage);
 void pagedir_set_dirty(uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed(uint32_t *pd, const void *upage);
 void pagedir_set_accessed(uint32_t *pd, const void *upage, bool accessed);
+void pagedir_set_writable(uint32_t *pd, const void *upage, bool writable);
+void pagedir_for_each(uint32_t *pd, pagedir_page_func *, void *aux);
 void pagedir_activate(uint32_t *pd);
 
 #endif /* userprog/pagedir.h */
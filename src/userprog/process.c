@@ -5,9 +5,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/fdtable.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
+#include "userprog/sysenter.h"
 #include "userprog/syscall.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -20,8 +22,10 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "vm/frame.h"
+#include "vm/share.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load(const char *cmdline, void (**eip)(void), void **esp);
 
 /*! Starts a new thread running a user program loaded from FILENAME.  The new
@@ -119,6 +123,70 @@ static void start_process(void * aux) {
     NOT_REACHED();
 }
 
+/*! What a child created by process_fork() needs from its parent.  Lives on
+    the parent's stack until the child ups DONE. */
+struct fork_info {
+    struct thread *parent;              /*!< The forking process. */
+    const struct intr_frame *frame;     /*!< Its system call frame. */
+    struct semaphore done;              /*!< Upped once the child is set up. */
+    bool success;                       /*!< Whether it was. */
+};
+
+/*! Creates a child process that is a copy of the current one, which is in
+    the system call whose frame is F.  The child has the same open files and
+    a copy-on-write view of the parent's memory, apart from its file
+    mappings, and returns 0 from the system call.  Returns the child's
+    thread id, once it is set up, or TID_ERROR if it cannot be created. */
+tid_t process_fork(const struct intr_frame *f) {
+    struct fork_info info;
+    tid_t tid;
+
+    info.parent = thread_current();
+    info.frame = f;
+    sema_init(&info.done, 0);
+    info.success = false;
+    tid = thread_create(thread_name(), PRI_DEFAULT, start_fork, &info);
+    if (tid == TID_ERROR)
+        return TID_ERROR;
+    sema_down(&info.done);
+    return info.success ? tid : TID_ERROR;
+}
+
+/*! A thread function that makes the current thread a copy of the process
+    that is forking it, and returns to user mode as that process would from
+    its system call. */
+static void start_fork(void *aux) {
+    struct fork_info *info = aux;
+    struct thread *parent = info->parent;
+    struct thread *cur = thread_current();
+    struct intr_frame if_ = *info->frame;
+    bool success = false;
+
+    cur->pagedir = pagedir_create();
+    if (cur->pagedir != NULL) {
+        process_activate();
+        if (parent->executable != NULL) {
+            cur->executable = file_reopen(parent->executable);
+            if (cur->executable != NULL)
+                file_deny_write(cur->executable);
+        }
+        success = (cur->executable != NULL || parent->executable == NULL) &&
+                  fd_table_clone(&cur->fds, &parent->fds) &&
+                  spt_fork(parent);
+    }
+    info->success = success;
+    sema_up(&info->done);
+    if (!success)
+        thread_exit();
+
+    /* The child's fork() returns 0.  A frame built by sysenter_entry does
+       not hold the data segment selectors, so set them for intr_exit. */
+    if_.eax = 0;
+    if_.gs = if_.fs = if_.es = if_.ds = SEL_UDSEG;
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+    NOT_REACHED();
+}
+
 /*! Waits for thread TID to die and returns its exit status.  If it was
     terminated by the kernel (i.e. killed due to an exception), returns -1.
     If TID is invalid or if it was not a child of the calling process, or if
@@ -149,11 +217,6 @@ void process_exit(void) {
     struct thread *cur = thread_current();
     uint32_t *pd;
 
-    if (cur->executable != NULL) {
-        file_close(cur->executable);
-        cur->executable = NULL;
-    }
-
     /* Destroy the current process's page directory and switch back
        to the kernel-only page directory. */
     pd = cur->pagedir;
@@ -164,11 +227,23 @@ void process_exit(void) {
            process page directory.  We must activate the base page
            directory before destroying the process's page
            directory, or our active page directory will be one
-           that's been freed (and cleared). */
+           that's been freed (and cleared).  Setting it under the
+           eviction lock lets an eviction that is taking one of our
+           pages finish first; later ones leave our pages alone. */
+        eviction_lock_acquire();
         cur->pagedir = NULL;
+        eviction_lock_release();
         pagedir_activate(NULL);
         pagedir_destroy(pd);
     }
+    spt_destroy(&cur->spt);
+
+    /* Close the executable only now, so that its inode, the key of any
+       shared pages we were mapping, stays open until they are gone. */
+    if (cur->executable != NULL) {
+        file_close(cur->executable);
+        cur->executable = NULL;
+    }
 }
 
 /*! Sets up the CPU for running user code in the current thread.
@@ -179,8 +254,10 @@ void process_activate(void) {
     /* Activate thread's page tables. */
     pagedir_activate(t->pagedir);
 
-    /* Set thread's kernel stack for use in processing interrupts. */
+    /* Set thread's kernel stack for use in processing interrupts and
+       SYSENTER. */
     tss_update();
+    sysenter_update();
 }
 
 /*! We load ELF binaries.  The following definitions are taken
@@ -288,29 +365,24 @@ bool load(const char *file_name_and_args, void (**eip) (void), void **esp) {
     // TODO(agf): Should eventually free save_ptr_page
 
     /* Open executable file. */
-    filesys_lock_acquire();
     file = filesys_open(file_name);
     if (file != NULL) {
         file_deny_write(file);
         thread_current()->executable = file;
     }
-    filesys_lock_release();
     if (file == NULL) {
         printf("load: %s: open failed\n", file_name);
         goto done;
     }
 
     /* Read and verify executable header. */
-    filesys_lock_acquire();
     if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr ||
         memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7) || ehdr.e_type != 2 ||
         ehdr.e_machine != 3 || ehdr.e_version != 1 ||
         ehdr.e_phentsize != sizeof(struct Elf32_Phdr) || ehdr.e_phnum > 1024) {
-        filesys_lock_release();
         printf("load: %s: error loading executable\n", file_name);
         goto done;
     }
-    filesys_lock_release();
 
     /* Read program headers. */
     file_ofs = ehdr.e_phoff;
@@ -319,14 +391,11 @@ bool load(const char *file_name_and_args, void (**eip) (void), void **esp) {
 
         if (file_ofs < 0 || file_ofs > file_length(file))
             goto done;
-        filesys_lock_acquire();
         file_seek(file, file_ofs);
 
         if (file_read(file, &phdr, sizeof phdr) != sizeof phdr) {
-            filesys_lock_release();
             goto done;
         }
-        filesys_lock_release();
 
         file_ofs += sizeof phdr;
 
@@ -459,12 +528,9 @@ static bool validate_segment(const struct Elf32_Phdr *phdr, struct file *file) {
         return false;
 
     /* p_offset must point within FILE. */
-    filesys_lock_acquire();
     if (phdr->p_offset > (Elf32_Off) file_length(file)) {
-        filesys_lock_release();
         return false;
     }
-    filesys_lock_release();
 
     /* p_memsz must be at least as big as p_filesz. */
     if (phdr->p_memsz < phdr->p_filesz)
@@ -552,48 +618,36 @@ bool load_page_from_spte(struct spt_entry *spte, bool pin) {
     if (spte == NULL || spte->file == NULL) {
         return false;
     }
-    // Here is an example situation in which filesys_lock could already be
-    // held:
-    // filesys_lock_acquire(), then file_read(), which causes a page fault,
-    // which causes load_page_from_spte() to be called.
-    // Pinning should resolve this situation.
-    ASSERT(!filesys_lock_held());
-    filesys_lock_acquire();
-    file_seek(spte->file, spte->file_ofs);
-    filesys_lock_release();
-
+    // Read-only pages of the executable are shared with other processes
+    // running it
+    if (!spte->writable && spte->mmapid == 0) {
+        return share_load_page(spte, pin);
+    }
     // Get a page of memory
-    // TODO(agf): We ned to make sure that the filesys lock is not held,
-    // because palloc might need to evict, and then it will need to acquire
-    // the filesys lock.
     uint8_t *kpage = palloc_get_page(PAL_USER);
     if (kpage == NULL) {
         return false;
     }
     // Load this page
     if (spte->file_read_bytes != 0) {
-        filesys_lock_acquire();
-        if (file_read(spte->file, kpage, spte->file_read_bytes) !=
-                (int) spte->file_read_bytes) {
-            filesys_lock_release();
+        if (file_read_at(spte->file, kpage, spte->file_read_bytes,
+                         spte->file_ofs) != (int) spte->file_read_bytes) {
             palloc_free_page(kpage);
             return false;
         }
-        filesys_lock_release();
     }
     size_t spte_zero_bytes = PGSIZE - spte->file_read_bytes;
     memset(kpage + spte->file_read_bytes, 0, spte_zero_bytes);
 
     if (pin) {
         // Pin the page in physical memory before installing it in userspace
-        bool acquired = lock_try_acquire(&ft_lookup(kpage)->lock);
-        ASSERT(acquired);
+        ft_pin(kpage);
     }
 
-    // Add the page to the process's address space
+    // Add the page to the process's address space. Freeing the frame drops
+    // any pin on it.
     if (!install_page(spte->key.addr, kpage, spte->writable)) {
         palloc_free_page(kpage);
-        // TODO(agf): Also unpin it
         return false;
     }
     return true;
@@ -625,8 +679,7 @@ bool allocate_and_install_blank_page(void *upage, bool pin) {
         return false;
     }
     if (pin) {
-        bool acquired = lock_try_acquire(&ft_lookup(kpage)->lock);
-        ASSERT(acquired);
+        ft_pin(kpage);
     }
     bool install_success = install_page(pg_round_down(upage), kpage, true);
     if (!install_success) {
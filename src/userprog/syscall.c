@@ -1,10 +1,14 @@
 #include "userprog/syscall.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/sysenter.h"
+#include "userprog/uaccess.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "filesys/file.h"
@@ -19,139 +23,130 @@
 // This seems like it should be defined elsewhere, but apparently is not.
 #define PAGE_SIZE_BYTES 4096
 
-static struct lock filesys_lock;
-
-static void syscall_handler(struct intr_frame *);
-
-void sys_halt(void);
-void check_pointer_validity(void *, struct intr_frame *);
-void check_many_pointer_validity(void *, void *, struct intr_frame *);
-void sys_exit(struct intr_frame *f);
-void sys_exec(struct intr_frame *f);
-void sys_open(struct intr_frame *f);
-void sys_filesize(struct intr_frame *f);
-void sys_read(struct intr_frame *f);
-void sys_write(struct intr_frame *f);
-void sys_seek(struct intr_frame *f);
-void sys_wait(struct intr_frame *f);
-void sys_create(struct intr_frame *f);
-void sys_remove(struct intr_frame *f);
-void sys_close(struct intr_frame *f);
-void sys_tell(struct intr_frame *f);
-void sys_mmap(struct intr_frame *f);
-void sys_munmap(struct intr_frame *f);
+// Also entered directly from sysenter_entry.
+void syscall_handler(struct intr_frame *);
+
+// A system call handler.  |args| holds the call's arguments, already copied
+// in from the user stack.
+typedef void syscall_func(struct intr_frame *f, const uint32_t *args);
+
+static syscall_func sys_halt;
+static syscall_func sys_exit;
+static syscall_func sys_exec;
+static syscall_func sys_open;
+static syscall_func sys_filesize;
+static syscall_func sys_read;
+static syscall_func sys_write;
+static syscall_func sys_seek;
+static syscall_func sys_wait;
+static syscall_func sys_create;
+static syscall_func sys_remove;
+static syscall_func sys_close;
+static syscall_func sys_tell;
+static syscall_func sys_mmap;
+static syscall_func sys_munmap;
+static syscall_func sys_pread;
+static syscall_func sys_pwrite;
+static syscall_func sys_readv;
+static syscall_func sys_writev;
+static syscall_func sys_sendfile;
+static syscall_func sys_dup2;
+static syscall_func sys_io_ring_enter;
+static syscall_func sys_fork;
+static syscall_func sys_fsync;
 
 void syscall_init(void) {
-    lock_init(&filesys_lock);
     intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+    sysenter_init();
 }
 
-void filesys_lock_acquire(void) {
-    lock_acquire(&filesys_lock);
+// Copies the string at user address |ustr| into a new page, which the
+// caller must free with palloc_free_page().  Returns NULL if the string does
+// not fit in a page or no page is free, and kills the process if the string
+// is not entirely in valid user memory.
+static char * copy_in_string(const char *ustr) {
+    char * kstr = palloc_get_page(0);
+    if (kstr == NULL) {
+        return NULL;
+    }
+    int len = strncpy_from_user(kstr, ustr, PGSIZE);
+    if (len < 0) {
+        palloc_free_page(kstr);
+        sys_exit_helper(-1);
+    }
+    if (len == PGSIZE) {
+        palloc_free_page(kstr);
+        return NULL;
+    }
+    return kstr;
 }
 
-bool filesys_lock_held(void) {
-    return lock_held_by_current_thread(&filesys_lock);
+// Returns the open file for |fd|, or NULL if |fd| is not an open file.
+static struct file * fd_to_file(int fd) {
+    return fd_table_get(&thread_current()->fds, fd);
 }
 
-void filesys_lock_release(void) {
-    lock_release(&filesys_lock);
-}
+// Most arguments any system call takes.
+#define SYSCALL_MAX_ARGS 4
+
+// Handler and argument count of each system call, by number.
+static const struct {
+    syscall_func *func;
+    int argc;
+} syscall_table[] = {
+    [SYS_HALT] = {sys_halt, 0},
+    [SYS_EXIT] = {sys_exit, 1},
+    [SYS_EXEC] = {sys_exec, 1},
+    [SYS_WAIT] = {sys_wait, 1},
+    [SYS_CREATE] = {sys_create, 2},
+    [SYS_REMOVE] = {sys_remove, 1},
+    [SYS_OPEN] = {sys_open, 1},
+    [SYS_FILESIZE] = {sys_filesize, 1},
+    [SYS_READ] = {sys_read, 3},
+    [SYS_WRITE] = {sys_write, 3},
+    [SYS_SEEK] = {sys_seek, 2},
+    [SYS_TELL] = {sys_tell, 1},
+    [SYS_CLOSE] = {sys_close, 1},
+    [SYS_MMAP] = {sys_mmap, 2},
+    [SYS_MUNMAP] = {sys_munmap, 1},
+    [SYS_PREAD] = {sys_pread, 4},
+    [SYS_PWRITE] = {sys_pwrite, 4},
+    [SYS_READV] = {sys_readv, 3},
+    [SYS_WRITEV] = {sys_writev, 3},
+    [SYS_SENDFILE] = {sys_sendfile, 4},
+    [SYS_DUP2] = {sys_dup2, 2},
+    [SYS_IO_RING_ENTER] = {sys_io_ring_enter, 2},
+    [SYS_FORK] = {sys_fork, 0},
+    [SYS_FSYNC] = {sys_fsync, 1},
+};
 
-/* Exit with status -1 if |p| is an invalid user pointer. */
-void check_pointer_validity(void *p, struct intr_frame *f) {
-    if (p == NULL || !is_user_vaddr(p)) {
-        sys_exit_helper(-1);
-    }
-    bool user_stack = false;
-    // TODO(agf): Document max stack size of 2048 * PGSIZE
-    // TODO(agf): This is very similar to the code in the pagefault handler
-    if (p >= (void *)((uint8_t *) f->esp - 32) &&
-            p >= PHYS_BASE - 2048 * PGSIZE) {
-        user_stack = true;
-        // TODO(agf): Updated this comment
-        // We know that the pointer is in userspace, so if it is not any lower
-        // than esp - 32 bytes, we assume that it is a stack access.
-        // This stack access might cause a page fault, which is fine; the page
-        // fault handler will grow the stack if needed.
-    }
-    struct thread * cur_thread = thread_current();
-    uint32_t *pd = cur_thread->pagedir;
-    // TODO(agf): A lot of this is repeated in the page fault handler
-    if (pagedir_get_page(pd, p) == NULL && spt_entry_lookup(p, NULL) == NULL) {
-        if (user_stack) {
-            bool pin = false;
-            if (cur_thread->pin_begin_page != NULL) {
-                ASSERT(cur_thread->pin_end_page != NULL);
-                ASSERT(pg_round_down(cur_thread->pin_begin_page) ==
-                       cur_thread->pin_begin_page);
-                ASSERT(pg_round_down(cur_thread->pin_end_page) ==
-                       cur_thread->pin_end_page);
-                unsigned char * round_addr = pg_round_down(p);
-                if (round_addr >= cur_thread->pin_begin_page &&
-                    round_addr <= cur_thread->pin_end_page) {
-                    pin = true;
-                }
-            }
-            if (allocate_and_install_blank_page(p, pin)) {
-                return;
-            }
-        }
+void syscall_handler(struct intr_frame *f) {
+    uint32_t args[SYSCALL_MAX_ARGS];
+    int syscall_num;
+    thread_current()->user_esp = f->esp;
+
+    // Copy the call number and then all of its arguments in one go; a bad
+    // stack pointer shows up as a failed copy rather than a page table walk
+    // per word.
+    if (!copy_from_user(&syscall_num, f->esp, sizeof syscall_num)) {
         sys_exit_helper(-1);
     }
-}
-
-/* Exit with status -1 if p is an invalid user pointer, for any p with
-   pmin <= p <= pmax. */
-void check_many_pointer_validity(void *pmin, void *pmax,
-                                 struct intr_frame *f) {
-    char * p;
-    for (p = (char *)pmin; p < (char *)pmax; p += PAGE_SIZE_BYTES) {
-        check_pointer_validity(p, f);
-    }
-    check_pointer_validity(pmax, f);
-}
-
-static void syscall_handler(struct intr_frame *f) {
-    check_pointer_validity(f->esp, f);
-    int syscall_num = *((int *) f->esp);
-    if (syscall_num == SYS_HALT) {
-        sys_halt();
-    } else if (syscall_num == SYS_EXIT) {
-        sys_exit(f);
-    } else if (syscall_num == SYS_EXEC) {
-        sys_exec(f);
-    } else if (syscall_num == SYS_WAIT) {
-        sys_wait(f);
-    } else if (syscall_num == SYS_CREATE) {
-        sys_create(f);
-    } else if (syscall_num == SYS_REMOVE) {
-        sys_remove(f);
-    } else if (syscall_num == SYS_OPEN) {
-        sys_open(f);
-    } else if (syscall_num == SYS_FILESIZE) {
-        sys_filesize(f);
-    } else if (syscall_num == SYS_READ) {
-        sys_read(f);
-    } else if (syscall_num == SYS_WRITE) {
-        sys_write(f);
-    } else if (syscall_num == SYS_SEEK) {
-        sys_seek(f);
-    } else if (syscall_num == SYS_TELL) {
-        sys_tell(f);
-    } else if (syscall_num == SYS_CLOSE) {
-        sys_close(f);
-    } else if (syscall_num == SYS_MMAP) {
-        sys_mmap(f);
-    } else if (syscall_num == SYS_MUNMAP) {
-        sys_munmap(f);
-    } else {
+    if (syscall_num < 0 ||
+            syscall_num >= (int) (sizeof syscall_table / sizeof *syscall_table) ||
+            syscall_table[syscall_num].func == NULL) {
         // TODO(agf)
         printf("system call: not handled!\n");
+        return;
+    }
+    if (!copy_from_user(args, (uint32_t *) f->esp + 1,
+                        syscall_table[syscall_num].argc * sizeof *args)) {
+        sys_exit_helper(-1);
     }
+    syscall_table[syscall_num].func(f, args);
 }
 
-void sys_halt() {
+static void sys_halt(struct intr_frame *f UNUSED,
+                     const uint32_t *args UNUSED) {
     shutdown_power_off();
 }
 
@@ -174,10 +169,8 @@ static bool sys_munmap_helper(mapid_t mapping) {
                 // But we do need this `if` statement, probably because
                 // mmap updates to entry fields are getting interrupted.
                 if (entry->file != NULL) {
-                    filesys_lock_acquire();
                     file_write_at(entry->file, entry->key.addr,
                                   entry->file_read_bytes, entry->file_ofs);
-                    filesys_lock_release();
                 }
             }
             file = entry->file;
@@ -190,157 +183,134 @@ static bool sys_munmap_helper(mapid_t mapping) {
 }
 
 void sys_exit_helper(int status) {
-    if (filesys_lock_held()) {
-        filesys_lock_release();
-    }
     printf("%s: exit(%d)\n", thread_name(), status);
     while (sys_munmap_helper(0));
     thread_current()->exit_status = status;
     thread_exit();
 }
 
-void sys_exit(struct intr_frame *f) {
-    int * status_p = (int *) f->esp + 1;
-    check_pointer_validity(status_p, f);
-    int status = *status_p;
+static void sys_exit(struct intr_frame *f, const uint32_t *args) {
+    int status = args[0];
     f->eax = status;
     sys_exit_helper(status);
 }
 
-void sys_wait(struct intr_frame *f) {
-    int * pid_p = (int *) f->esp + 1;
-    check_pointer_validity(pid_p, f);
-    int pid = *pid_p;
+static void sys_wait(struct intr_frame *f, const uint32_t *args) {
+    int pid = args[0];
     int status = process_wait(pid);
     f->eax = status;
 }
 
-void sys_exec(struct intr_frame *f) {
-    const char ** cmd_line_p = (const char **) f->esp + 1;
-    check_pointer_validity(cmd_line_p, f);
-    tid_t tid = process_execute(*cmd_line_p);
+// Returns the child's pid to the parent, and 0 to the child, which starts
+// out sharing the parent's pages copy-on-write.
+static void sys_fork(struct intr_frame *f, const uint32_t *args UNUSED) {
+    tid_t tid = process_fork(f);
     f->eax = tid;
     if (tid == TID_ERROR) {
         f->eax = -1;
     }
 }
 
-void sys_open(struct intr_frame *f) {
-    struct thread *intr_trd = thread_current();
-    int i;
-    for (i = 0; i < MAX_FILE_DESCRIPTORS; i++) {
-        if (intr_trd->open_files[i] == NULL) {
-            // char ** file_name_p = (char
-            char * file_name = (char *) *((int *) f->esp + 1);
-            check_pointer_validity(file_name, f);
-            filesys_lock_acquire();
-            struct file * afile = filesys_open(file_name);
-            filesys_lock_release();
-
-            /* Check file successfully opened */
-            if (!afile) {
-                f->eax = -1;
-                return;
-            }
-
-            intr_trd->open_files[i] = afile;
-            f->eax = i + 2;
-            return;
-        }
+static void sys_exec(struct intr_frame *f, const uint32_t *args) {
+    char * cmd_line = copy_in_string((const char *) args[0]);
+    if (cmd_line == NULL) {
+        f->eax = -1;
+        return;
+    }
+    tid_t tid = process_execute(cmd_line);
+    palloc_free_page(cmd_line);
+    f->eax = tid;
+    if (tid == TID_ERROR) {
+        f->eax = -1;
     }
 }
 
-void sys_close(struct intr_frame *f) {
-    check_pointer_validity((int *) f->esp + 1, f);
-    int fd = *((int *) f->esp + 1);
-    int open_files_index = fd - 2;
-    if (open_files_index < 0 || open_files_index >= MAX_FILE_DESCRIPTORS) {
+static void sys_open(struct intr_frame *f, const uint32_t *args) {
+    char * file_name = copy_in_string((const char *) args[0]);
+    if (file_name == NULL) {
+        f->eax = -1;
         return;
     }
-    struct thread * intr_trd = thread_current();
-    struct file *file = intr_trd->open_files[open_files_index];
-    if (file != NULL) {
-        filesys_lock_acquire();
-        file_close(file);
-        filesys_lock_release();
-        intr_trd->open_files[open_files_index] = NULL;
-    }
-}
+    struct file * afile = filesys_open(file_name);
+    palloc_free_page(file_name);
 
-void sys_tell(struct intr_frame *f) {
-    check_pointer_validity((int *) f->esp + 1, f);
-    int fd = *((int *) f->esp + 1);
-    int open_files_index = fd - 2;
-    if (open_files_index < 0 || open_files_index >= MAX_FILE_DESCRIPTORS) {
+    /* Check file successfully opened */
+    if (!afile) {
         f->eax = -1;
         return;
     }
-    struct thread * intr_trd = thread_current();
-    struct file *file = intr_trd->open_files[open_files_index];
+
+    int fd = fd_table_install(&thread_current()->fds, afile);
+    if (fd < 0) {
+        file_close(afile);
+    }
+    f->eax = fd;
+}
+
+static void sys_close(struct intr_frame *f UNUSED, const uint32_t *args) {
+    int fd = args[0];
+    fd_table_close(&thread_current()->fds, fd);
+}
+
+static void sys_tell(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
+    struct file *file = fd_to_file(fd);
     if (file == NULL) {
         f->eax = -1;
         return;
     }
-    filesys_lock_acquire();
     f->eax = file_tell(file);
-    filesys_lock_release();
-}
-
-void sys_filesize(struct intr_frame *f) {
-    int fd = *((int *) f->esp + 1);
-    struct thread *intr_trd = thread_current();
-    struct file *afile = intr_trd->open_files[fd - 2];
-    filesys_lock_acquire();
-    f->eax = file_length(afile);
-    filesys_lock_release();
-}
-
-void sys_read(struct intr_frame *f) {
-    int fd = *((int *) f->esp + 1);
-    char * buf = (char *) *((int *) f->esp + 2);
-    unsigned n = (unsigned) *((int *) f->esp + 3);
-    // TODO(agf): Decide what to do here
-    // check_pointer_validity(buf, f);
-    // check_pointer_validity(buf + n - 1, f);
-    check_many_pointer_validity(buf, buf + n - 1, f);
+}
+
+static void sys_filesize(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
+    struct file *afile = fd_to_file(fd);
+    f->eax = afile != NULL ? file_length(afile) : -1;
+}
+
+static void sys_read(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
+    char * buf = (char *) args[1];
+    unsigned n = args[2];
     /* Read from console */
     if (fd == 0) {
-        unsigned i;
-        for (i = 0; i < n; i++) {
-            buf[i] = input_getc();
-            /* TODO: what if input buffer has less than i keys? */
+        // Nothing is held while waiting for keys, so there is no need to pin
+        // the buffer; gather them a chunk at a time and copy each chunk out.
+        char chunk[64];
+        unsigned done, i;
+        for (done = 0; done < n; done += i) {
+            for (i = 0; i < sizeof chunk && done + i < n; i++) {
+                chunk[i] = input_getc();
+                /* TODO: what if input buffer has less than i keys? */
+            }
+            if (!copy_to_user(buf + done, chunk, i)) {
+                sys_exit_helper(-1);
+            }
         }
         f->eax =  n;
+        return;
     }
     /* Read from file */
-    else {
-        if (fd > MAX_FILE_DESCRIPTORS + 1 || fd < 2) {
-            sys_exit_helper(-1);
-        }
-        struct thread *intr_trd = thread_current();
-        /* Subtract 2 because fd 0 and 1 are taken for IO */
-        struct file *afile = intr_trd->open_files[fd - 2];
-        if (!afile) {
-            sys_exit_helper(-1);
-        }
-        pin_pages_by_buffer((unsigned char *)buf, n);
-        filesys_lock_acquire();
-        f->eax = file_read(afile, buf, n);
-        filesys_lock_release();
-        unpin_pages_by_buffer((unsigned char *)buf, n);
+    // Validate, load and pin the whole buffer up front.
+    if (!pin_user_buffer(buf, n, true, f->esp)) {
+        sys_exit_helper(-1);
+    }
+    struct file *afile = fd_to_file(fd);
+    if (!afile) {
+        unpin_user_buffer(buf, n);
+        sys_exit_helper(-1);
     }
+    f->eax = file_read(afile, buf, n);
+    unpin_user_buffer(buf, n);
 }
 
-void sys_write(struct intr_frame *f) {
-    int * fd_p = (int *) f->esp + 1;
-    check_pointer_validity(fd_p, f);
-    int fd = *fd_p;
-    char ** buf_p = (char **) ((int *) f->esp + 2);
-    check_pointer_validity(buf_p, f);
-    char * buf = *buf_p;
-    unsigned * n_p = (unsigned *) ((int *) f->esp + 3);
-    check_pointer_validity(n_p, f);
-    unsigned n = *n_p;
+static void sys_write(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
+    char * buf = (char *) args[1];
+    unsigned n = args[2];
+    if (!pin_user_buffer(buf, n, false, f->esp)) {
+        sys_exit_helper(-1);
+    }
 
     /* Write to console */
     if (fd == 1) {
@@ -350,54 +320,45 @@ void sys_write(struct intr_frame *f) {
     }
     /* Write to file */
     else {
-        struct thread *intr_trd = thread_current();
-        /* Subtract 2 because fd 0 and 1 are taken for IO */
-        struct file *afile = intr_trd->open_files[fd - 2];
-        pin_pages_by_buffer((unsigned char *)buf, n);
-        filesys_lock_acquire();
-        f->eax = file_write(afile, buf, n);
-        filesys_lock_release();
-        unpin_pages_by_buffer((unsigned char *)buf, n);
-    }
-}
-
-void sys_create(struct intr_frame *f) {
-    char ** file_p = (char **) ((int *) f->esp + 1);
-    check_pointer_validity(file_p, f);
-    char * file = *file_p;
-    unsigned int * initial_size_p = (unsigned int *) f->esp + 2;
-    check_pointer_validity(initial_size_p, f);
-    unsigned int initial_size = *initial_size_p;
-    if (strlen(file) == 0) {
+        struct file *afile = fd_to_file(fd);
+        f->eax = afile != NULL ? file_write(afile, buf, n) : -1;
+    }
+    unpin_user_buffer(buf, n);
+}
+
+static void sys_create(struct intr_frame *f, const uint32_t *args) {
+    char * file = copy_in_string((const char *) args[0]);
+    unsigned int initial_size = args[1];
+    if (file == NULL || strlen(file) == 0) {
+        if (file != NULL) {
+            palloc_free_page(file);
+        }
         f->eax = 0;
         return;
     }
-    filesys_lock_acquire();
     int success = filesys_create(file, initial_size);
-    filesys_lock_release();
+    palloc_free_page(file);
     f->eax = success;
 }
 
-void sys_remove(struct intr_frame *f) {
-    check_pointer_validity((int *) f->esp + 1, f);
-    char * file = *((char **) ((int *) f->esp + 1));
-    filesys_lock_acquire();
+static void sys_remove(struct intr_frame *f, const uint32_t *args) {
+    char * file = copy_in_string((const char *) args[0]);
+    if (file == NULL) {
+        f->eax = 0;
+        return;
+    }
     int success = filesys_remove(file);
-    filesys_lock_release();
+    palloc_free_page(file);
     f->eax = success;
 }
 
-void sys_seek(struct intr_frame *f) {
-    check_pointer_validity((int *) f->esp + 1, f);
-    int fd = *((int *) f->esp + 1);
-    check_pointer_validity((int *) f->esp + 2, f);
-    off_t position = (off_t) *((int *) f->esp + 2);
-    struct thread *intr_trd = thread_current();
-    struct file *afile = intr_trd->open_files[fd - 2];
-
-    filesys_lock_acquire();
-    file_seek(afile, position);
-    filesys_lock_release();
+static void sys_seek(struct intr_frame *f UNUSED, const uint32_t *args) {
+    int fd = args[0];
+    off_t position = (off_t) args[1];
+    struct file *afile = fd_to_file(fd);
+    if (afile != NULL) {
+        file_seek(afile, position);
+    }
 }
 
 /*
@@ -405,16 +366,14 @@ void sys_seek(struct intr_frame *f) {
  * Maps the file open as fd into the process's virtual address space.
  * The entire file is mapped into consecutive virtual pages starting at addr.
  */
-void sys_mmap(struct intr_frame *f) {
-    check_pointer_validity((int *) f->esp + 1, f);
-    int fd = *((int *) f->esp + 1);
+static void sys_mmap(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
     // fd can't be I/O
     if (fd == 0 || fd == 1) {
         f->eax = -1;
         return;
     }
-    check_pointer_validity((int *) f->esp + 2, f);
-    void *addr = (void *) *((int *) f->esp + 2);
+    void *addr = (void *) args[1];
     struct thread * intr_trd = thread_current();
     // Pintos assumes virtual page 0 is not mapped
     if (addr == 0 ||
@@ -428,12 +387,11 @@ void sys_mmap(struct intr_frame *f) {
         f->eax = -1;
         return;
     }
-    int open_files_index = fd - 2;
-    if (open_files_index < 0 || open_files_index >= MAX_FILE_DESCRIPTORS) {
+    if (fd < FD_FIRST || fd >= FD_FIRST + FD_MAX) {
         f->eax = -1;
         return;
     }
-    struct file *file = intr_trd->open_files[open_files_index];
+    struct file *file = fd_to_file(fd);
     if (file == NULL) {
         sys_exit_helper(-1);
     }
@@ -470,8 +428,351 @@ void sys_mmap(struct intr_frame *f) {
  * by a previous call to mmap by the same process that has not yet been
  * unmapped.
  */
-void sys_munmap(struct intr_frame *f) {
-    check_pointer_validity((int *) f->esp + 1, f);
-    mapid_t mapping = (mapid_t) *((int *) f->esp + 1);
+static void sys_munmap(struct intr_frame *f UNUSED, const uint32_t *args) {
+    mapid_t mapping = (mapid_t) args[0];
     sys_munmap_helper(mapping);
 };
+
+/* int pread (int fd, void *buffer, unsigned size, unsigned offset)
+ * Reads size bytes from the file open as fd, starting at offset, into buffer.
+ * The file's position is not used or changed.
+ */
+static void sys_pread(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
+    char * buf = (char *) args[1];
+    unsigned n = args[2];
+    off_t offset = (off_t) args[3];
+    struct file *afile = fd_to_file(fd);
+    if (afile == NULL || offset < 0) {
+        f->eax = -1;
+        return;
+    }
+    if (!pin_user_buffer(buf, n, true, f->esp)) {
+        sys_exit_helper(-1);
+    }
+    f->eax = file_read_at(afile, buf, n, offset);
+    unpin_user_buffer(buf, n);
+}
+
+/* int pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+ * Writes size bytes from buffer into the file open as fd, starting at offset.
+ * The file's position is not used or changed.
+ */
+static void sys_pwrite(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
+    char * buf = (char *) args[1];
+    unsigned n = args[2];
+    off_t offset = (off_t) args[3];
+    struct file *afile = fd_to_file(fd);
+    if (afile == NULL || offset < 0) {
+        f->eax = -1;
+        return;
+    }
+    if (!pin_user_buffer(buf, n, false, f->esp)) {
+        sys_exit_helper(-1);
+    }
+    f->eax = file_write_at(afile, buf, n, offset);
+    unpin_user_buffer(buf, n);
+}
+
+// A run of user pages, from |begin| to |end| inclusive.
+struct page_run {
+    unsigned char * begin;
+    unsigned char * end;
+};
+
+// Unpins the runs pinned by pin_iovecs().
+static void unpin_iovecs(struct page_run *runs, int run_cnt) {
+    int i;
+    for (i = 0; i < run_cnt; i++) {
+        unpin_user_buffer(runs[i].begin, runs[i].end - runs[i].begin + PGSIZE);
+    }
+}
+
+// Copies the iovec array at |uiov| into |iov|, then validates and pins the
+// pages of every buffer it describes with pin_user_buffer().  Buffers that
+// share pages are merged into one run first, so each page is pinned exactly
+// once; the runs are stored into |runs| for unpin_iovecs().  |write| is
+// true if the buffers will be written to.  Returns the number of runs.
+static int pin_iovecs(const struct iovec *uiov, int iovcnt,
+                      struct iovec *iov, struct page_run *runs,
+                      bool write, struct intr_frame *f) {
+    int i, j, run_cnt = 0;
+    if (!copy_from_user(iov, uiov, iovcnt * sizeof *iov)) {
+        sys_exit_helper(-1);
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        char * base = iov[i].iov_base;
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        if (!is_user_vaddr(base + iov[i].iov_len - 1) ||
+            base + iov[i].iov_len - 1 < base) {
+            sys_exit_helper(-1);
+        }
+
+        // Insert the buffer's pages, keeping |runs| sorted by start page.
+        struct page_run run = {pg_round_down(base),
+                               pg_round_down(base + iov[i].iov_len - 1)};
+        for (j = run_cnt; j > 0 && runs[j - 1].begin > run.begin; j--) {
+            runs[j] = runs[j - 1];
+        }
+        runs[j] = run;
+        run_cnt++;
+    }
+
+    // Merge runs that overlap or touch.
+    if (run_cnt > 0) {
+        j = 0;
+        for (i = 1; i < run_cnt; i++) {
+            if (runs[i].begin <= runs[j].end + PGSIZE) {
+                if (runs[i].end > runs[j].end) {
+                    runs[j].end = runs[i].end;
+                }
+            } else {
+                runs[++j] = runs[i];
+            }
+        }
+        run_cnt = j + 1;
+    }
+
+    for (i = 0; i < run_cnt; i++) {
+        if (!pin_user_buffer(runs[i].begin,
+                             runs[i].end - runs[i].begin + PGSIZE, write,
+                             f->esp)) {
+            unpin_iovecs(runs, i);
+            sys_exit_helper(-1);
+        }
+    }
+    return run_cnt;
+}
+
+// Shared by readv() and writev(): reads or writes the buffers described by
+// the iovec array in one pass over the file, starting at its current
+// position, and stops early at a short transfer.
+static void sys_readv_writev(struct intr_frame *f, const uint32_t *args,
+                             bool write) {
+    struct iovec iov[IOV_MAX];
+    struct page_run runs[IOV_MAX];
+    int fd = args[0];
+    const struct iovec * uiov = (const struct iovec *) args[1];
+    int iovcnt = args[2];
+    if (iovcnt < 0 || iovcnt > IOV_MAX) {
+        f->eax = -1;
+        return;
+    }
+    if (iovcnt == 0) {
+        f->eax = 0;
+        return;
+    }
+
+    struct file *afile = NULL;
+    if (!(write ? fd == 1 : fd == 0)) {
+        afile = fd_to_file(fd);
+        if (afile == NULL) {
+            f->eax = -1;
+            return;
+        }
+    }
+
+    int run_cnt = pin_iovecs(uiov, iovcnt, iov, runs, !write, f);
+    int total = 0;
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        char * base = iov[i].iov_base;
+        off_t len = iov[i].iov_len;
+        off_t done;
+        if (len == 0) {
+            continue;
+        }
+        if (afile == NULL && write) {
+            putbuf(base, len);
+            done = len;
+        } else if (afile == NULL) {
+            for (done = 0; done < len; done++) {
+                base[done] = input_getc();
+            }
+        } else if (write) {
+            done = file_write(afile, base, len);
+        } else {
+            done = file_read(afile, base, len);
+        }
+        total += done;
+        if (done < len) {
+            break;
+        }
+    }
+    unpin_iovecs(runs, run_cnt);
+    f->eax = total;
+}
+
+/* int readv (int fd, const struct iovec *iov, int iovcnt)
+ * Reads from the file open as fd into each of the iovcnt buffers in turn,
+ * like one read() into their concatenation.
+ */
+static void sys_readv(struct intr_frame *f, const uint32_t *args) {
+    sys_readv_writev(f, args, false);
+}
+
+/* int writev (int fd, const struct iovec *iov, int iovcnt)
+ * Writes each of the iovcnt buffers in turn to the file open as fd, like one
+ * write() of their concatenation.
+ */
+static void sys_writev(struct intr_frame *f, const uint32_t *args) {
+    sys_readv_writev(f, args, true);
+}
+
+// cache_read_func for sendfile() to the console.
+static void send_to_console(const void *data, size_t size, void *aux UNUSED) {
+    putbuf(data, size);
+}
+
+/* int sendfile (int out_fd, int in_fd, unsigned offset, unsigned count)
+ * Copies up to count bytes of the file open as in_fd, starting at offset, to
+ * out_fd, without passing them through user memory.  The position of in_fd
+ * is not used or changed; the data is written at the position of out_fd,
+ * which may be the console.  Returns the number of bytes copied.
+ */
+static void sys_sendfile(struct intr_frame *f, const uint32_t *args) {
+    int out_fd = args[0];
+    int in_fd = args[1];
+    off_t offset = (off_t) args[2];
+    unsigned count = args[3];
+    struct file *in_file = fd_to_file(in_fd);
+    if (in_file == NULL || offset < 0) {
+        f->eax = -1;
+        return;
+    }
+    off_t size = count < INT32_MAX ? (off_t) count : INT32_MAX;
+
+    // To the console: straight out of the buffer cache.
+    if (out_fd == 1) {
+        f->eax = file_read_with(in_file, size, offset, send_to_console, NULL);
+        return;
+    }
+
+    // To a file: through one kernel page.  Writing from inside
+    // file_read_with() would hold the source's inode lock and a cache block
+    // while taking the destination's, which deadlocks when the two files are
+    // the same or two processes copy between them in opposite directions.
+    struct file *out_file = fd_to_file(out_fd);
+    if (out_file == NULL) {
+        f->eax = -1;
+        return;
+    }
+    void *page = palloc_get_page(0);
+    if (page == NULL) {
+        f->eax = -1;
+        return;
+    }
+    off_t total = 0;
+    while (total < size) {
+        off_t chunk = size - total < PGSIZE ? size - total : PGSIZE;
+        off_t bytes_read = file_read_at(in_file, page, chunk, offset + total);
+        if (bytes_read == 0) {
+            break;
+        }
+        off_t bytes_written = file_write(out_file, page, bytes_read);
+        total += bytes_written;
+        if (bytes_written < bytes_read) {
+            break;
+        }
+    }
+    palloc_free_page(page);
+    f->eax = total;
+}
+
+/* int dup2 (int oldfd, int newfd)
+ * Makes newfd refer to the file open as oldfd, closing newfd first if it was
+ * open.  The two descriptors share a file position.  Returns newfd, or -1 if
+ * oldfd is not open or newfd cannot name a file.
+ */
+static void sys_dup2(struct intr_frame *f, const uint32_t *args) {
+    int oldfd = args[0];
+    int newfd = args[1];
+    f->eax = fd_table_dup2(&thread_current()->fds, oldfd, newfd);
+}
+
+/* int fsync (int fd)
+ * Writes what has been written to the file open as fd to disk, along with
+ * every other change made to the file system before the call, so that it
+ * survives a crash.  Returns 0, or -1 if fd is not open.
+ */
+static void sys_fsync(struct intr_frame *f, const uint32_t *args) {
+    int fd = args[0];
+    if (fd_to_file(fd) == NULL) {
+        f->eax = -1;
+        return;
+    }
+    filesys_sync();
+    f->eax = 0;
+}
+
+// Performs the operation |sqe| queued by io_ring_enter(), exactly as if it
+// had been made as a system call of its own, and returns its result.
+static int io_ring_perform(struct intr_frame *f, const struct io_sqe *sqe) {
+    switch (sqe->op) {
+    case SYS_READ:
+    case SYS_WRITE:
+    case SYS_SEEK:
+    case SYS_TELL:
+    case SYS_OPEN:
+    case SYS_CLOSE:
+    case SYS_FILESIZE:
+    case SYS_PREAD:
+    case SYS_PWRITE:
+        break;
+    default:
+        return -1;
+    }
+    f->eax = 0;
+    syscall_table[sqe->op].func(f, sqe->args);
+    return f->eax;
+}
+
+/* int io_ring_enter (struct io_ring *ring, unsigned to_submit)
+ * Performs up to to_submit operations queued on ring, in order, posting a
+ * completion for each.  Stops early if the submission queue empties or the
+ * completion queue fills.  Returns the number of operations performed, or -1
+ * if ring is malformed.
+ */
+static void sys_io_ring_enter(struct intr_frame *f, const uint32_t *args) {
+    struct io_ring * uring = (struct io_ring *) args[0];
+    unsigned to_submit = args[1];
+    struct io_ring ring;
+    if (!copy_from_user(&ring, uring, sizeof ring)) {
+        sys_exit_helper(-1);
+    }
+    if (ring.entries == 0 || (ring.entries & (ring.entries - 1)) != 0) {
+        f->eax = -1;
+        return;
+    }
+
+    unsigned mask = ring.entries - 1;
+    unsigned done;
+    for (done = 0; done < to_submit && ring.sq_head != ring.sq_tail &&
+             ring.cq_tail - ring.cq_head < ring.entries; done++) {
+        struct io_sqe sqe;
+        struct io_cqe cqe;
+        if (!copy_from_user(&sqe, &ring.sqes[ring.sq_head & mask],
+                            sizeof sqe)) {
+            sys_exit_helper(-1);
+        }
+        cqe.user_data = sqe.user_data;
+        cqe.result = io_ring_perform(f, &sqe);
+        if (!copy_to_user(&ring.cqes[ring.cq_tail & mask], &cqe,
+                          sizeof cqe)) {
+            sys_exit_helper(-1);
+        }
+        ring.sq_head++;
+        ring.cq_tail++;
+    }
+
+    if (!copy_to_user(&uring->sq_head, &ring.sq_head, sizeof ring.sq_head) ||
+            !copy_to_user(&uring->cq_tail, &ring.cq_tail,
+                          sizeof ring.cq_tail)) {
+        sys_exit_helper(-1);
+    }
+    f->eax = done;
+}
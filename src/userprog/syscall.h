@@ -5,9 +5,6 @@
 
 void syscall_init(void);
 
-void filesys_lock_acquire(void);
-bool filesys_lock_held(void);
-void filesys_lock_release(void);
 void sys_exit_helper(int status);
 
 #endif /* userprog/syscall.h */
@@ -0,0 +1,70 @@
+#include "userprog/sysenter.h"
+#include <debug.h>
+#include <stdint.h>
+#include "userprog/gdt.h"
+#include "threads/loader.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/*! Model-specific registers that configure SYSENTER.  See [IA32-v3a] 4.8.7
+    "Performing Fast Calls to System Procedures with the SYSENTER and SYSEXIT
+    Instructions". @{ */
+#define MSR_SYSENTER_CS 0x174   /*!< Kernel code selector. */
+#define MSR_SYSENTER_ESP 0x175  /*!< Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /*!< Kernel entry point. */
+/*! @} */
+
+/*! CPUID leaf 1 EDX bit for SYSENTER and SYSEXIT. */
+#define CPUID_SEP (1u << 11)
+
+/*! Entry point, in sysenter-entry.S. */
+void sysenter_entry(void);
+
+/*! True if SYSENTER is set up. */
+static bool enabled;
+
+/*! Writes VALUE to model-specific register MSR. */
+static void wrmsr(uint32_t msr, uint32_t value) {
+    asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
+/*! Returns true if the CPU supports SYSENTER.  Early Pentium Pros set the
+    CPUID bit without implementing the instructions. */
+static bool cpu_has_sysenter(void) {
+    uint32_t eax, ebx, ecx, edx;
+    unsigned family, model, stepping;
+
+    asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    family = (eax >> 8) & 0xf;
+    model = (eax >> 4) & 0xf;
+    stepping = eax & 0xf;
+    if (family == 6 && model < 3 && stepping < 3)
+        return false;
+    return (edx & CPUID_SEP) != 0;
+}
+
+/*! Sets up SYSENTER as a second way into syscall_handler(), alongside
+    int $0x30, if the CPU has it.  User programs check CPUID themselves to
+    choose between the two. */
+void sysenter_init(void) {
+    if (!cpu_has_sysenter())
+        return;
+
+    /* SYSENTER loads SS from the CS selector plus 8, and SYSEXIT loads CS and
+       SS from it plus 16 and plus 24, which the GDT layout matches: SEL_KDSEG,
+       SEL_UCSEG and SEL_UDSEG. */
+    ASSERT(SEL_KDSEG == SEL_KCSEG + 8);
+    ASSERT(SEL_UCSEG == (SEL_KCSEG + 16) + 3);
+    ASSERT(SEL_UDSEG == (SEL_KCSEG + 24) + 3);
+    wrmsr(MSR_SYSENTER_CS, SEL_KCSEG);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    enabled = true;
+    sysenter_update();
+}
+
+/*! Points SYSENTER at the running thread's kernel stack, as tss_update()
+    does for interrupts.  Called on every switch to a thread. */
+void sysenter_update(void) {
+    if (enabled)
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t) thread_current() + PGSIZE);
+}
@@ -0,0 +1,96 @@
+#include "userprog/uaccess.h"
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/*! The exception table, gathered from every EX_TABLE_ENTRY() by the linker
+    script. */
+extern const struct ex_entry _start_ex_table[], _end_ex_table[];
+
+/*! Returns true if the SIZE bytes at UADDR lie entirely below PHYS_BASE.
+    Whether they are mapped is left to the page fault handler. */
+static bool is_user_range(const void *uaddr, size_t size) {
+    uintptr_t start = (uintptr_t) uaddr;
+    return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+/*! Copies SIZE bytes from SRC to DST, one of which is a user address that
+    the caller has range-checked.  Returns false if the copy faulted. */
+static bool copy_bytes(void *dst, const void *src, size_t size) {
+    int result;
+
+    asm volatile ("1: rep movsb\n"
+                  "   xorl %0, %0\n"
+                  "2:\n"
+                  EX_TABLE_ENTRY("1b", "2b")
+                  : "=a" (result), "+D" (dst), "+S" (src), "+c" (size)
+                  : : "memory");
+    return result == 0;
+}
+
+/*! Reads the byte at user address UADDR.  Returns it, or -1 if the read
+    faulted. */
+static inline int get_user_byte(const uint8_t *uaddr) {
+    int result;
+
+    asm ("1: movzbl %1, %0\n"
+         "2:\n"
+         EX_TABLE_ENTRY("1b", "2b")
+         : "=a" (result) : "m" (*uaddr));
+    return result;
+}
+
+/*! Copies SIZE bytes from user address USRC to kernel address DST.  Pages
+    that are not resident are brought in by the page fault handler as the
+    copy touches them, so nothing is looked up in advance.  Returns false,
+    having copied an unspecified prefix, if any byte of the source is not a
+    valid user address. */
+bool copy_from_user(void *dst, const void *usrc, size_t size) {
+    return is_user_range(usrc, size) && copy_bytes(dst, usrc, size);
+}
+
+/*! Copies SIZE bytes from kernel address SRC to user address UDST.  Returns
+    false, having copied an unspecified prefix, if any byte of the
+    destination is not a valid, writable user address. */
+bool copy_to_user(void *udst, const void *src, size_t size) {
+    return is_user_range(udst, size) && copy_bytes(udst, src, size);
+}
+
+/*! Copies the null-terminated string at user address USRC, terminator
+    included, into DST, which has room for SIZE bytes.  Returns the length of
+    the string; SIZE if it does not fit, in which case DST is not terminated;
+    or -1 if the string runs into memory that is not a valid user address.
+    Every byte is checked as it is copied, not just the first. */
+int strncpy_from_user(char *dst, const char *usrc, size_t size) {
+    const uint8_t *src = (const uint8_t *) usrc;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        int c;
+
+        if (!is_user_vaddr(src + i))
+            return -1;
+        c = get_user_byte(src + i);
+        if (c < 0)
+            return -1;
+        dst[i] = c;
+        if (c == '\0')
+            return i;
+    }
+    return size;
+}
+
+/*! Called by the page fault handler for a kernel access to user memory that
+    it could not resolve.  If the faulting instruction has an exception table
+    entry, redirects F to its fixup and returns true. */
+bool uaccess_fixup(struct intr_frame *f) {
+    const struct ex_entry *e;
+
+    for (e = _start_ex_table; e < _end_ex_table; e++) {
+        if (e->insn == (uintptr_t) f->eip) {
+            f->eip = (void (*)(void)) e->fixup;
+            f->eax = (uint32_t) -1;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,33 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct intr_frame;
+
+/*! An exception table entry.  If the kernel instruction at INSN faults on a
+    user address, and the page fault handler cannot make the access succeed
+    by loading or allocating the page, execution resumes at FIXUP with eax set
+    to -1 instead of killing the process. */
+struct ex_entry {
+    uintptr_t insn;                     /*!< Address of the instruction. */
+    uintptr_t fixup;                    /*!< Where to continue. */
+};
+
+/*! Emits an exception table entry, from inline assembly, for the labels
+    INSN and FIXUP. */
+#define EX_TABLE_ENTRY(INSN, FIXUP)                     \
+    ".pushsection __ex_table, \"a\"\n"                  \
+    ".balign 4\n"                                       \
+    ".long " INSN ", " FIXUP "\n"                       \
+    ".popsection\n"
+
+bool copy_from_user(void *dst, const void *usrc, size_t size);
+bool copy_to_user(void *udst, const void *src, size_t size);
+int strncpy_from_user(char *dst, const char *usrc, size_t size);
+
+bool uaccess_fixup(struct intr_frame *);
+
+#endif /* userprog/uaccess.h */
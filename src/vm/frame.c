@@ -2,9 +2,11 @@
 #include <stdio.h>
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -33,6 +35,30 @@ static struct ft_entry * clock_hand;
 
 static struct lock eviction_lock;
 
+// The most pages that frame_evict() writes to swap in one go. When a frame
+// has to be evicted, a few more victims are picked along with it and the
+// whole cluster goes to adjacent swap slots in one burst of writes. The
+// extra frames are returned to the user pool, so the next few allocations
+// find a free frame without evicting.
+#define EVICT_CLUSTER 8
+
+// How many frames past the ones it must evict frame_evict() looks at to fill
+// up the rest of a cluster.
+#define EVICT_CLUSTER_SCAN 32
+
+// The pageout daemon evicts pages in the background, so that a thread that
+// needs a frame rarely has to wait for an eviction itself. It is woken when
+// fewer than pageout_low_water user frames are free, and evicts until
+// pageout_high_water frames are free.
+static size_t pageout_low_water;
+static size_t pageout_high_water;
+
+// Upped to wake the pageout daemon.
+static struct semaphore pageout_sema;
+
+// True from when the pageout daemon is woken until it next goes to sleep.
+static bool pageout_wanted;
+
 
 bool eviction_lock_held(void) {
     return lock_held_by_current_thread(&eviction_lock);
@@ -59,12 +85,16 @@ void frame_table_init(void) {
     for (i = 0; i < num_user_frames; i++) {
         struct ft_entry * entry = frame_table + i;
         entry->kernel_vaddr = NULL;
-        entry->user_vaddr = NULL;
-        entry->trd = NULL;
-        lock_init(&entry->lock);
-        entry->acquired_during_eviction = false;
+        list_init(&entry->mappers);
+        entry->inline_mapper.trd = NULL;
+        entry->pin_cnt = 0;
+        entry->shared = false;
+        entry->inode = NULL;
     }
     lock_init(&eviction_lock);
+    share_init();
+    sema_init(&pageout_sema, 0);
+    pageout_wanted = false;
     clock_hand = frame_table;
     end_of_frame_table = frame_table + num_user_frames;
 }
@@ -74,6 +104,31 @@ struct ft_entry * ft_lookup(void *kernel_vaddr) {
     return frame_table + (pg_no(kernel_vaddr) - user_pool_base_pg_no);
 }
 
+// Returns a new mapper for |fte|: the one stored in |fte| itself, if it is
+// free, or else a newly allocated one.
+static struct ft_mapper * mapper_create(struct ft_entry * fte) {
+    if (fte->inline_mapper.trd == NULL) {
+        return &fte->inline_mapper;
+    }
+    struct ft_mapper * mapper = malloc(sizeof *mapper);
+    if (mapper == NULL) {
+        PANIC("frame: out of memory for frame mappings");
+    }
+    return mapper;
+}
+
+// Removes |mapper| from the reverse map of |fte| and frees it.
+static void mapper_destroy(struct ft_entry * fte, struct ft_mapper * mapper) {
+    list_remove(&mapper->elem);
+    if (mapper == &fte->inline_mapper) {
+        mapper->trd = NULL;
+    } else {
+        free(mapper);
+    }
+}
+
+// Records that |kpage| is mapped at |upage| in |trd|, or the current thread
+// if |trd| is NULL. Called by pagedir_set_page().
 void ft_add_user_mapping(void *upage, void *kpage, struct thread * trd) {
     if (trd == NULL) {
         trd = thread_current();
@@ -84,10 +139,20 @@ void ft_add_user_mapping(void *upage, void *kpage, struct thread * trd) {
     struct ft_entry * entry = ft_lookup(kpage);
     // TODO(agf): ASSERT(entry->kernel_vaddr == NULL) ?
     ASSERT(entry->kernel_vaddr == NULL || entry->kernel_vaddr == kpage);
-    ASSERT(entry->user_vaddr == NULL);
+    // Only a shared frame, or one that fork() shares copy-on-write, is
+    // mapped more than once, and the extra mappings are added with the
+    // eviction lock held
+    ASSERT(list_empty(&entry->mappers) || eviction_lock_held());
+    ASSERT(!entry->shared || eviction_lock_held());
+    struct ft_mapper * mapper = mapper_create(entry);
+    mapper->trd = trd;
+    mapper->user_vaddr = upage;
+    // Eviction may be looking at the reverse map, without disabling
+    // interrupts, but never in the middle of a change made with them off
+    enum intr_level old_level = intr_disable();
     entry->kernel_vaddr = kpage;
-    entry->user_vaddr = upage;
-    entry->trd = trd;
+    list_push_back(&entry->mappers, &mapper->elem);
+    intr_set_level(old_level);
 }
 
 // TODO(agf): Rename to something like set_kernel_vaddr()
@@ -96,8 +161,8 @@ void ft_init_entry(void *kpage) {
     ASSERT(pg_round_down(kpage) == kpage);
     struct ft_entry * entry = ft_lookup(kpage);
     entry->kernel_vaddr = kpage;
-    entry->user_vaddr = NULL;
-    entry->trd = NULL;
+    ASSERT(list_empty(&entry->mappers));
+    ASSERT(!entry->shared);
 }
 
 // Set kernel_vaddr for several frame table entries
@@ -114,9 +179,10 @@ void ft_deinit_entry(void *kpage) {
     // TODO(agf): Assert page offset is zero, and it is a kernel page, etc.
     struct ft_entry * entry = ft_lookup(kpage);
     entry->kernel_vaddr = NULL;
-    entry->user_vaddr = NULL;
-    entry->trd = NULL;
-    entry->acquired_during_eviction = false;
+    // Pins left behind by a process killed in the middle of a system call
+    entry->pin_cnt = 0;
+    ASSERT(list_empty(&entry->mappers));
+    ASSERT(!entry->shared);
 }
 
 // Reset several frame table entries
@@ -130,18 +196,289 @@ void ft_deinit_entries(void *kpage, size_t page_cnt) {
     }
 }
 
-// Find a physical page, write its contents to swap, and return its kernel
-// virtual address
-// TODO(agf): This actually evicts multiple pages, because palloc_get_multiple
-// seems to need this. Is this really necessary?
-void * frame_evict(size_t page_cnt) {
-    /// printf("AGF: Eviction is happening\n");
+// Removes the current process's mapping of |kpage| at |upage| from the
+// reverse map of |kpage|, leaving the page directory alone. Returns true if
+// that was the last mapping of the frame. Must be called with the eviction
+// lock held.
+bool ft_remove_user_mapping(void * kpage, void * upage) {
+    ASSERT(eviction_lock_held());
+    struct ft_entry * fte = ft_lookup(kpage);
+    struct list_elem * e;
+    for (e = list_begin(&fte->mappers); e != list_end(&fte->mappers);
+         e = list_next(e)) {
+        struct ft_mapper * mapper = list_entry(e, struct ft_mapper, elem);
+        if (mapper->trd == thread_current() && mapper->user_vaddr == upage) {
+            mapper_destroy(fte, mapper);
+            break;
+        }
+    }
+    return list_empty(&fte->mappers);
+}
+
+// Returns true if |kpage|, which the current process maps, is shared
+// copy-on-write with another process since a fork(), so that a write to it
+// needs a copy. Must be called with the eviction lock held.
+bool ft_is_cow(void * kpage) {
+    ASSERT(eviction_lock_held());
+    struct ft_entry * fte = ft_lookup(kpage);
+    return !fte->shared && list_size(&fte->mappers) > 1;
+}
+
+// Frees the frame at |kpage|, which the current process maps at |upage|,
+// as the process's page directory is destroyed. A frame that other
+// processes map too is only freed when its last mapping goes.
+void ft_free_user_page(void * kpage, void * upage) {
+    struct ft_entry * fte = ft_lookup(kpage);
+    // Once the process's page directory is gone, eviction leaves the frames
+    // it maps alone; the eviction lock keeps it from walking the reverse map
+    // while we change it.
+    ASSERT(thread_current()->pagedir == NULL);
+    eviction_lock_acquire();
+    bool last = ft_remove_user_mapping(kpage, upage);
+    if (last && fte->shared) {
+        share_remove(fte);
+    }
+    eviction_lock_release();
+    if (last) {
+        palloc_free_page(kpage);
+    }
+}
+
+// Pins the frame at |kpage|, so that it is not evicted until a matching
+// ft_unpin(). The frame may be pinned any number of times.
+// A frame that is mapped may only be pinned with the eviction lock held, so
+// that it cannot be pinned while it is being evicted; one that is not mapped
+// yet cannot be evicted, and may be pinned before it is mapped without it.
+void ft_pin(void * kpage) {
+    struct ft_entry * fte = ft_lookup(kpage);
+    enum intr_level old_level = intr_disable();
+    ASSERT(eviction_lock_held() || list_empty(&fte->mappers));
+    fte->pin_cnt++;
+    intr_set_level(old_level);
+}
+
+// Unpins the frame at |kpage|, pinned by ft_pin().
+void ft_unpin(void * kpage) {
+    struct ft_entry * fte = ft_lookup(kpage);
+    enum intr_level old_level = intr_disable();
+    ASSERT(fte->pin_cnt > 0);
+    fte->pin_cnt--;
+    intr_set_level(old_level);
+}
+
+// Returns true if |fte| holds a page that is mapped into user space by
+// processes that are not exiting, and that is not pinned. These are the
+// frames that eviction may consider.
+static bool ft_in_use(struct ft_entry * fte) {
+    if (fte->kernel_vaddr == NULL || list_empty(&fte->mappers) ||
+        fte->pin_cnt > 0) {
+        return false;
+    }
+    struct list_elem * e;
+    for (e = list_begin(&fte->mappers); e != list_end(&fte->mappers);
+         e = list_next(e)) {
+        if (list_entry(e, struct ft_mapper, elem)->trd->pagedir == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns true if |vaddr| has been accessed through |pagedir|. If |clear| is
+// true, also clears its accessed bit.
+static bool test_accessed(uint32_t * pagedir, const void * vaddr, bool clear) {
+    bool accessed = pagedir_is_accessed(pagedir, vaddr);
+    if (accessed && clear) {
+        pagedir_set_accessed(pagedir, vaddr, false);
+    }
+    return accessed;
+}
+
+// Returns true if the page in |fte|, which must be in use, has been accessed
+// through any of its mappings, so that a page is only old to the clock hand
+// if it is old to every process that maps it. If |clear| is true, also
+// clears the accessed bits, all of them.
+static bool ft_accessed(struct ft_entry * fte, bool clear) {
+    bool accessed = false;
+    struct list_elem * e;
+    for (e = list_begin(&fte->mappers); e != list_end(&fte->mappers);
+         e = list_next(e)) {
+        struct ft_mapper * mapper = list_entry(e, struct ft_mapper, elem);
+        accessed |= test_accessed(mapper->trd->pagedir, mapper->user_vaddr,
+                                  clear);
+    }
+    // Kernel mappings are the same in every page directory
+    uint32_t * pagedir = list_entry(list_front(&fte->mappers),
+                                    struct ft_mapper, elem)->trd->pagedir;
+    accessed |= test_accessed(pagedir, fte->kernel_vaddr, clear);
+    return accessed;
+}
+
+// Unmaps the page in |fte| from every process that maps it, leaving the
+// reverse map as it is. Returns true if the page was written to through any
+// of the mappings. Each mapping's dirty bit is read and the mapping removed
+// with interrupts off, so that no write can slip in between.
+static bool ft_unmap_all(struct ft_entry * fte) {
+    bool dirty = false;
+    struct list_elem * e;
+    for (e = list_begin(&fte->mappers); e != list_end(&fte->mappers);
+         e = list_next(e)) {
+        struct ft_mapper * mapper = list_entry(e, struct ft_mapper, elem);
+        ASSERT(mapper->trd->pagedir != NULL);
+        enum intr_level old_level = intr_disable();
+        dirty |= pagedir_is_dirty(mapper->trd->pagedir, mapper->user_vaddr);
+        pagedir_clear_page(mapper->trd->pagedir, mapper->user_vaddr);
+        intr_set_level(old_level);
+    }
+    return dirty;
+}
+
+// Returns true if |fte| can be evicted along with a cluster of other frames:
+// it holds a user page that has not been accessed since the clock hand last
+// passed it and that nobody has pinned. Clears the accessed bits of a page
+// that has been accessed, as the clock hand would.
+static bool claim_for_cluster(struct ft_entry * fte) {
+    return ft_in_use(fte) && !ft_accessed(fte, true);
+}
+
+// Pages on their way to swap, written out together by swap_batch_flush()
+struct swap_batch {
+    struct spt_entry * sptes[EVICT_CLUSTER];
+    void * kpages[EVICT_CLUSTER];
+    size_t cnt;
+};
+
+// Writes the pages in |batch| to swap and empties it. Each page goes to its
+// old slot, if it has one, or else to a new one. New slots are adjacent if
+// there is a long enough run of free slots, and all of the writes are issued
+// back to back.
+static void swap_batch_flush(struct swap_batch * batch) {
+    int slots[EVICT_CLUSTER];
+    size_t new_slot_cnt = 0;
+    size_t i;
+    for (i = 0; i < batch->cnt; i++) {
+        if (batch->sptes[i]->swap_page_number == -1) {
+            new_slot_cnt++;
+        }
+    }
+    int first_slot = new_slot_cnt > 0 ? swap_alloc(new_slot_cnt) : -1;
+    for (i = 0; i < batch->cnt; i++) {
+        struct spt_entry * spte = batch->sptes[i];
+        if (spte->swap_page_number != -1) {
+            swap_slot_lock(spte->swap_page_number);
+        } else if (first_slot != -1) {
+            spte->swap_page_number = first_slot++;
+        } else {
+            spte->swap_page_number = swap_alloc(1);
+            ASSERT(spte->swap_page_number != -1);
+        }
+        slots[i] = spte->swap_page_number;
+    }
+    swap_write_pages(slots, batch->kpages, batch->cnt);
+    batch->cnt = 0;
+}
+
+// Adds the page at |kpage|, described by |spte|, to |batch|, flushing the
+// batch first if it is full.
+static void swap_batch_add(struct swap_batch * batch, struct spt_entry * spte,
+                           void * kpage) {
+    if (batch->cnt == EVICT_CLUSTER) {
+        swap_batch_flush(batch);
+    }
+    batch->sptes[batch->cnt] = spte;
+    batch->kpages[batch->cnt++] = kpage;
+}
+
+// Takes the pages in the |cnt| frames |victims| away from their owners,
+// saving them wherever they need to go. None of the victims may be pinned;
+// holding the eviction lock keeps them from being pinned meanwhile.
+// Where a page goes depends on where it came from and whether it has been
+// written to since:
+// - a shared executable page is unmapped from every process that maps it,
+//   and dropped;
+// - an mmap page is written back to its file if it is dirty, and never goes
+//   to swap;
+// - a clean page that can be read back from its executable, or that already
+//   has an up-to-date copy in swap, is just dropped;
+// - any other page is written to swap: to its old slot, if it has one, or
+//   else to a new one, with all of the cluster's writes issued together.
+// A page that fork() shares copy-on-write is saved once for each process
+// that maps it, since each process's SPT entry owns its swap slot.
+static void evict_cluster(struct ft_entry ** victims, size_t cnt) {
+    struct swap_batch batch;
+    batch.cnt = 0;
+    ASSERT(cnt <= EVICT_CLUSTER);
+
+    size_t i;
+    for (i = 0; i < cnt; i++) {
+        struct ft_entry * fte = victims[i];
+        ASSERT(page_from_pool(user_pool, fte->kernel_vaddr));
+        if (fte->shared) {
+            // Each mapper loads the page back through the shared page cache
+            ft_unmap_all(fte);
+            while (!list_empty(&fte->mappers)) {
+                mapper_destroy(fte, list_entry(list_front(&fte->mappers),
+                                               struct ft_mapper, elem));
+            }
+            share_remove(fte);
+            continue;
+        }
+
+        // Unmap the page from user space before it is saved, so that its
+        // owners cannot change it in the meantime. If an owner touches the
+        // page again, it faults, and waits in spt_entry_load() for the
+        // eviction lock before loading it back.
+        bool dirty = ft_unmap_all(fte);
+
+        struct list_elem * e;
+        for (e = list_begin(&fte->mappers); e != list_end(&fte->mappers);
+             e = list_next(e)) {
+            struct ft_mapper * mapper = list_entry(e, struct ft_mapper, elem);
+            struct spt_entry * spte = spt_entry_get_or_create(
+                mapper->user_vaddr, mapper->trd);
+            spte->trd = mapper->trd;
+            if (spte->file != NULL && spte->mmapid != 0) {
+                if (dirty) {
+                    file_write_at(spte->file, fte->kernel_vaddr,
+                                  spte->file_read_bytes, spte->file_ofs);
+                }
+            } else if (dirty || (spte->file == NULL &&
+                                 spte->swap_page_number == -1)) {
+                // From now on the page lives in swap, not in its file
+                spte->file = NULL;
+                swap_batch_add(&batch, spte, fte->kernel_vaddr);
+            }
+        }
+    }
+    swap_batch_flush(&batch);
+
+    for (i = 0; i < cnt; i++) {
+        struct ft_entry * fte = victims[i];
+        fte->kernel_vaddr = NULL;
+        while (!list_empty(&fte->mappers)) {
+            mapper_destroy(fte, list_entry(list_front(&fte->mappers),
+                                           struct ft_mapper, elem));
+        }
+    }
+}
+
+// Evicts |page_cnt| contiguous pages and returns the kernel virtual address
+// of the first of their frames. If |wait| is false, gives up and returns
+// NULL once the clock hand has swept past every frame without finding them,
+// as happens when every frame is pinned, not yet mapped or owned by an
+// exiting process; otherwise keeps looking until some are let go.
+static void * evict_pages(size_t page_cnt, bool wait) {
     eviction_lock_acquire();
     // Find page_cnt contiguous pages that we can evict
-    for (; true; clock_hand++) {
+    size_t swept;
+    for (swept = 0; true; swept++, clock_hand++) {
         if (clock_hand == end_of_frame_table) {
             clock_hand = frame_table;
         }
+        if (!wait && swept == num_user_frames) {
+            eviction_lock_release();
+            return NULL;
+        }
         bool can_evict = true;
         size_t i;
         for (i = 0; i < page_cnt; i++) {
@@ -150,46 +487,19 @@ void * frame_evict(size_t page_cnt) {
                 can_evict = false;
                 break;
             }
-            if (fte->kernel_vaddr == NULL ||
-                fte->user_vaddr == NULL ||
-                fte->trd == NULL ||
-                fte->trd->pagedir == NULL) {
-                // TODO(agf): Check that we really need conditions other than
-                // just fte->kernel_vaddr == NULL
-                can_evict = false;
-                continue;
-            }
-            if (pagedir_is_accessed(fte->trd->pagedir, fte->kernel_vaddr)) {
+            // A pinned frame is not in use as far as eviction goes. Pins
+            // on mapped frames are only taken with the eviction lock held,
+            // so the frames chosen here stay unpinned until they are gone.
+            if (!ft_in_use(fte)) {
                 can_evict = false;
-                if (i == 0) {
-                    pagedir_set_accessed(fte->trd->pagedir,
-                                         fte->kernel_vaddr, false);
-                }
+                break;
             }
-            if (pagedir_is_accessed(fte->trd->pagedir, fte->user_vaddr)) {
+            if (ft_accessed(fte, i == 0)) {
                 can_evict = false;
-                if (i == 0) {
-                    pagedir_set_accessed(fte->trd->pagedir,
-                                         fte->user_vaddr, false);
-                }
-            }
-            if (!fte->acquired_during_eviction) {
-                // TODO(agf): This is racy. This is a big problem.
-                if (!lock_held_by_current_thread(&fte->lock)) {
-                    bool acquired = lock_try_acquire(&fte->lock);
-                    if (acquired) {
-                        fte->acquired_during_eviction = true;
-                    } else {
-                        can_evict = false;
-                    }
-                }
             }
         }
         if (can_evict) {
             break;
-        } else if (clock_hand->acquired_during_eviction) {
-            clock_hand->acquired_during_eviction = false;
-            lock_release(&clock_hand->lock);
         }
         // TODO(agf): Panic if this is infinite-looping
     }
@@ -198,105 +508,199 @@ void * frame_evict(size_t page_cnt) {
     // Kernel virtual address to return
     void * kernel_vaddr = clock_hand->kernel_vaddr;
 
-    // Evict page_cnt pages, starting at clock_hand
+    // Evict page_cnt pages, starting at clock_hand, along with whatever
+    // other victims fit in the same cluster
+    struct ft_entry * victims[EVICT_CLUSTER];
+    size_t cnt = 0;
     size_t i;
     for (i = 0; i < page_cnt; i++) {
-        struct ft_entry * fte = clock_hand + i;
-        ASSERT(fte < end_of_frame_table);
-        ASSERT(page_from_pool(user_pool, fte->kernel_vaddr));
-
-        struct spt_entry * spte = spt_entry_get_or_create(fte->user_vaddr,
-                                                          fte->trd);
-
-        // TODO(agf): If the frame is from a read-only part of an executable
-        // file, we shouldn't use swap, because we can just read back from the
-        // executable. The frame table should include data to describe this.
-        // TODO(agf): The frame table could also describe whether the page in
-        // the frame is currently pinned.
-        // Should pin pages before reading into them from swap.
-        int swap_slot = swap_dump_ft_entry(fte);
-        ASSERT(swap_slot != -1);
-        // Update SPT
-        spte->trd = fte->trd;
-        spte->swap_page_number = swap_slot;
-        spte->file = NULL;
-
-        // Unmap the page from user space
-        ASSERT(fte->trd->pagedir != NULL);
-        pagedir_clear_page(fte->trd->pagedir, fte->user_vaddr);
-
-        fte->kernel_vaddr = NULL;
-        fte->user_vaddr = NULL;
-        fte->trd = NULL;
-
-        fte->acquired_during_eviction = false;
-        lock_release(&fte->lock);
+        ASSERT(clock_hand + i < end_of_frame_table);
+        victims[cnt++] = clock_hand + i;
+        if (cnt == EVICT_CLUSTER) {
+            evict_cluster(victims, cnt);
+            cnt = 0;
+        }
     }
+    size_t first_extra = cnt;
+    struct ft_entry * fte = clock_hand + page_cnt;
+    size_t scanned;
+    for (scanned = 0; scanned < EVICT_CLUSTER_SCAN && cnt < EVICT_CLUSTER;
+         scanned++, fte++) {
+        if (fte == end_of_frame_table) {
+            fte = frame_table;
+        }
+        if (fte >= clock_hand && fte < clock_hand + page_cnt) {
+            // Wrapped all the way around
+            break;
+        }
+        if (claim_for_cluster(fte)) {
+            victims[cnt++] = fte;
+        }
+    }
+    void * extra_kpages[EVICT_CLUSTER];
+    for (i = first_extra; i < cnt; i++) {
+        extra_kpages[i] = victims[i]->kernel_vaddr;
+    }
+    evict_cluster(victims, cnt);
+    clock_hand = fte;
 
     eviction_lock_release();
+
+    // Hand the extra frames back to the user pool
+    for (i = first_extra; i < cnt; i++) {
+        palloc_free_page(extra_kpages[i]);
+    }
     return kernel_vaddr;
 }
 
-void pin_pages(unsigned char * uaddr, size_t num_pages) {
-    ASSERT(is_user_vaddr(uaddr));
-    ASSERT(pg_round_down(uaddr) == uaddr);
-    ASSERT(num_pages > 0);
-    bool need_pgfault_handler = false;
-    size_t i = 0;
-    struct thread * cur_thread = thread_current();
-    uint32_t * pagedir = cur_thread->pagedir;
-    eviction_lock_acquire();
-    for (; i < num_pages; i++) {
-        void * kaddr = pagedir_get_page(pagedir, uaddr + i * PGSIZE);
-        if (kaddr == NULL) {
-            need_pgfault_handler = true;
-        } else {
-            bool acquired = lock_try_acquire(&ft_lookup(kaddr)->lock);
-            ASSERT(acquired);
-        }
-        if (need_pgfault_handler) {
-            cur_thread->pin_begin_page = uaddr;
-            cur_thread->pin_end_page = uaddr + (num_pages - 1) * PGSIZE;
-        }
-    }
-    eviction_lock_release();
-    if (need_pgfault_handler) {
-        // The messy code with "throwaway" is intended to force the compiler
-        // to perform a pointer dereference, which causes a pagefault.
-        unsigned char volatile throwaway = 0;
-        for (i = 0; i < num_pages; i++) {
-            throwaway = *((unsigned char *)(uaddr + i * PGSIZE));
-            if (throwaway == 0) {
-                throwaway += 1;
+// Find a physical page, evict the page in it, and return its kernel virtual
+// address
+// TODO(agf): This actually evicts multiple pages, because palloc_get_multiple
+// seems to need this. Is this really necessary?
+void * frame_evict(size_t page_cnt) {
+    return evict_pages(page_cnt, true);
+}
+
+// Body of the pageout daemon. Evicts a cluster of pages at a time, and
+// returns all of their frames to the user pool, until the high watermark is
+// reached. Gives up early if a whole sweep of the clock finds nothing to
+// evict, rather than holding the eviction lock until something turns up:
+// the next allocation wakes it again.
+static void pageout_daemon(void * aux UNUSED) {
+    for (;;) {
+        sema_down(&pageout_sema);
+        while (user_pool->free_cnt < pageout_high_water) {
+            void * kpage = evict_pages(1, false);
+            if (kpage == NULL) {
+                break;
             }
-            // Use throwaway to assert something that is always true so that
-            // the compiler does not get rid of throwaway.
-            ASSERT(throwaway >= 1);
+            palloc_free_page(kpage);
         }
+        pageout_wanted = false;
     }
-    cur_thread->pin_begin_page = NULL;
-    cur_thread->pin_end_page = NULL;
 }
 
-void unpin_pages(unsigned char * uaddr, size_t num_pages) {
-    ASSERT(is_user_vaddr(uaddr));
-    ASSERT(pg_round_down(uaddr) == uaddr);
+// Starts the pageout daemon. Must be called once swap is ready.
+void frame_pageout_init(void) {
+    pageout_low_water = num_user_frames / 16;
+    pageout_high_water = num_user_frames / 8;
+    thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+}
+
+// Wakes the pageout daemon if free user frames are running low. Called after
+// each allocation from the user pool.
+void frame_pageout_wake(void) {
+    if (user_pool->free_cnt >= pageout_low_water) {
+        return;
+    }
+    enum intr_level old_level = intr_disable();
+    bool wake = !pageout_wanted;
+    pageout_wanted = true;
+    intr_set_level(old_level);
+    if (wake) {
+        sema_up(&pageout_sema);
+    }
+}
+
+// Returns true if |upage| may be allocated as a new stack page for a process
+// whose stack pointer is |esp|. Mirrors the check in the page fault handler.
+static bool is_stack_page(const uint8_t * upage, const void * esp) {
+    return (upage + PGSIZE - 1 >= (const uint8_t *) esp - 32 &&
+            upage >= (const uint8_t *) PHYS_BASE - 2048 * PGSIZE);
+}
+
+// Unpins the pages from |first| up to but not including |end|, which the
+// current thread pinned.
+static void unpin_range(uint8_t * first, uint8_t * end) {
     uint32_t * pagedir = thread_current()->pagedir;
-    size_t i;
-    for (i = 0; i < num_pages; i++) {
-        void * kaddr = pagedir_get_page(pagedir, uaddr + i * PGSIZE);
+    uint8_t * upage;
+    for (upage = first; upage < end; upage += PGSIZE) {
+        void * kaddr = pagedir_get_page(pagedir, upage);
         ASSERT(kaddr != NULL);
-        lock_release(&ft_lookup(kaddr)->lock);
+        ft_unpin(kaddr);
     }
 }
 
-void pin_pages_by_buffer(unsigned char * buffer, off_t num_bytes) {
-    unsigned char * start = pg_round_down(buffer);
-    int num_pages = pg_no(buffer + num_bytes) - pg_no(buffer) + 1;
-    pin_pages(start, num_pages);
+// Validates the user buffer of |size| bytes at |buffer|, makes all of its
+// pages resident and pins them, so that a system call can then access it
+// without page faults and without any of it being evicted. Pins nest, so
+// the same buffer may be pinned by several system calls at once.
+// The pages that are already resident are pinned under the eviction lock,
+// which is only dropped to load a missing page straight from its file or
+// swap slot (or to allocate it as a stack page, if it is just below |esp|),
+// instead of touching it to take a page fault, and to give the process its
+// own copy of a page shared copy-on-write, in case the system call writes
+// to it.
+// |write| is true if the system call will write into the buffer, which is
+// then checked to be writable too. That has to be done here, before the
+// system call takes any file system locks: a write fault on a read-only
+// page kills the process on the spot, with those locks still held.
+// Returns false, with nothing left pinned, if any page of the buffer is not
+// valid user memory or cannot be loaded, or is read-only and |write| is
+// true.
+bool pin_user_buffer(const void * buffer, size_t size, bool write,
+                     const void * esp) {
+    const uint8_t * start = buffer;
+    if (size == 0) {
+        return true;
+    }
+    if (start == NULL || start + size - 1 < start ||
+        !is_user_vaddr(start + size - 1)) {
+        return false;
+    }
+    uint8_t * first = pg_round_down(start);
+    uint8_t * last = pg_round_down(start + size - 1);
+    uint32_t * pagedir = thread_current()->pagedir;
+    uint8_t * upage;
+
+    // Check that the missing pages can be loaded before loading any, and
+    // that the pages are writable if need be. A page without an SPT entry
+    // is an anonymous page, which always is.
+    eviction_lock_acquire();
+    for (upage = first; upage <= last; upage += PGSIZE) {
+        struct spt_entry * spte = spt_entry_lookup(upage, NULL);
+        if ((write && spte != NULL && !spte->writable) ||
+            (pagedir_get_page(pagedir, upage) == NULL && spte == NULL &&
+             !is_stack_page(upage, esp))) {
+            eviction_lock_release();
+            return false;
+        }
+    }
+
+    for (upage = first; upage <= last; upage += PGSIZE) {
+        // A page may have been read in around an earlier one
+        void * kaddr = pagedir_get_page(pagedir, upage);
+        if (kaddr != NULL && !ft_is_cow(kaddr)) {
+            ft_pin(kaddr);
+            continue;
+        }
+        eviction_lock_release();
+        // The shared page may be evicted before it is copied, and then has
+        // to be loaded after all
+        bool pinned = kaddr != NULL && spt_break_cow(upage, true);
+        if (!pinned) {
+            struct spt_entry * spte = spt_entry_lookup(upage, NULL);
+            pinned = (spte != NULL ? spt_entry_load(spte, write, true)
+                                   : allocate_and_install_blank_page(upage,
+                                                                     true));
+        }
+        eviction_lock_acquire();
+        if (!pinned) {
+            eviction_lock_release();
+            unpin_range(first, upage);
+            return false;
+        }
+    }
+    eviction_lock_release();
+    return true;
 }
-void unpin_pages_by_buffer(unsigned char * buffer, off_t num_bytes) {
-    unsigned char * start = pg_round_down(buffer);
-    int num_pages = pg_no(buffer + num_bytes) - pg_no(buffer) + 1;
-    unpin_pages(start, num_pages);
+
+// Unpins a buffer pinned by pin_user_buffer().
+void unpin_user_buffer(const void * buffer, size_t size) {
+    const uint8_t * start = buffer;
+    if (size == 0) {
+        return;
+    }
+    unpin_range(pg_round_down(start),
+                (uint8_t *) pg_round_down(start + size - 1) + PGSIZE);
 }
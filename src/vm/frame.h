@@ -1,23 +1,48 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <hash.h>
+#include <list.h>
 #include "filesys/off_t.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "threads/loader.h"
 
+// One mapping of a frame into a process's address space: an entry in the
+// frame's reverse map
+struct ft_mapper {
+    struct list_elem elem;
+    struct thread * trd;
+    void * user_vaddr;
+};
+
 // Frame table entry
 struct ft_entry {
     // Kernel virtual address of page that occupies this frame
     void * kernel_vaddr;
-    // User virtual address (if any) of the page that occupies this frame
-    void * user_vaddr;
-    // Thread associated with this user address
-    struct thread * trd;
-    // Used to synchronize eviction and pinning
-    struct lock lock;
-    // Scratch space used during eviction
-    bool acquired_during_eviction;
+    // Reverse map: every user address, in every process, at which the page
+    // in this frame is mapped. Empty if the frame is free or not mapped yet.
+    // Changes are made with the eviction lock held or interrupts off.
+    struct list mappers;
+    // Storage for the first mapper, so that a frame with a single mapping,
+    // the usual case, needs no allocation. Free if its |trd| is NULL.
+    struct ft_mapper inline_mapper;
+    // Number of pins on the frame. Eviction leaves a pinned frame alone.
+    // Any number of system calls, in any number of processes, may pin a
+    // frame at once, and the same one may pin it more than once. Changed
+    // with interrupts off; see ft_pin().
+    int pin_cnt;
+
+    // True if the frame holds a read-only executable page that any number of
+    // processes may map; see vm/share.c. All of these fields are protected
+    // by the eviction lock.
+    bool shared;
+    // Where the page came from, which is also its key in the shared page
+    // cache
+    struct inode * inode;
+    off_t file_ofs;
+    size_t file_read_bytes;
+    struct hash_elem share_elem;
 };
 
 bool eviction_lock_held(void);
@@ -40,14 +65,24 @@ void ft_deinit_entry(void *);
 
 void ft_deinit_entries(void *, size_t);
 
+bool ft_remove_user_mapping(void *, void *);
+
+bool ft_is_cow(void *);
+
+void ft_free_user_page(void *, void *);
+
+void ft_pin(void *);
+
+void ft_unpin(void *);
+
 void * frame_evict(size_t);
 
-void pin_pages(unsigned char *, size_t);
+void frame_pageout_init(void);
 
-void unpin_pages(unsigned char *, size_t);
+void frame_pageout_wake(void);
 
-void pin_pages_by_buffer(unsigned char *, off_t);
+bool pin_user_buffer(const void *, size_t, bool write, const void *esp);
 
-void unpin_pages_by_buffer(unsigned char *, off_t);
+void unpin_user_buffer(const void *, size_t);
 
 #endif  // vm/frame.h
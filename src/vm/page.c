@@ -1,10 +1,15 @@
 #include "vm/page.h"
 #include "vm/frame.h"
+#include "vm/swap.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include <stdio.h>
+#include <string.h>
 
 void spt_init(struct hash *spt) {
     hash_init(spt, spt_entry_hash, spt_entry_less, NULL);
@@ -85,6 +90,9 @@ struct spt_entry * spt_entry_get_or_create(void * address,
 
     // It is important that some fields be initialized
     entry->file = NULL;
+    entry->file_read_bytes = 0;
+    entry->writable = true;
+    entry->mmapid = 0;
     entry->swap_page_number = -1;
     entry->trd = trd;
 
@@ -112,3 +120,269 @@ struct spt_entry * spt_entry_lookup(void *address, struct hash * spt) {
     elem = hash_find(spt, &entry.hash_elem);
     return elem != NULL ? hash_entry(elem, struct spt_entry, hash_elem) : NULL;
 }
+
+// How many pages on either side of a page read in from swap are read along
+// with it, if they are in the neighbouring swap slots.
+#define SWAP_READ_AROUND 4
+
+// Tries to read the page of |trd| at |upage| in from swap slot |slot|,
+// speculatively, while a neighbouring page is being swapped in.
+// Returns false, having done nothing, if the page is not waiting in that slot
+// or there is no free frame for it; a speculative read never evicts.
+// The page is mapped with its accessed bits clear, so that the clock hand
+// takes the frame back first if the page goes unused; since it keeps its swap
+// slot, that costs no I/O.
+// Must be called with the eviction lock held.
+static bool swap_read_ahead(struct thread * trd, uint8_t * upage, int slot) {
+    ASSERT(eviction_lock_held());
+    if (!is_user_vaddr(upage) || upage == NULL ||
+        pagedir_get_page(trd->pagedir, upage) != NULL) {
+        return false;
+    }
+    struct spt_entry * spte = spt_entry_lookup(upage, &trd->spt);
+    if (spte == NULL || spte->swap_page_number != slot) {
+        return false;
+    }
+    uint8_t * kpage = palloc_get_page(PAL_USER | PAL_NOEVICT);
+    if (kpage == NULL) {
+        return false;
+    }
+    swap_slot_lock(slot);
+    swap_read_page(slot, (char *) kpage);
+    swap_slot_unlock(slot);
+    bool result = pagedir_set_page(trd->pagedir, upage, kpage, true);
+    ASSERT(result);
+    pagedir_set_accessed(trd->pagedir, upage, false);
+    pagedir_set_accessed(trd->pagedir, kpage, false);
+    return true;
+}
+
+// Reads in from swap the pages around |spte|'s that follow it in swap as
+// they do in memory, on the bet that a process that faulted on one page of
+// an array will soon fault on the pages next to it too. Stops in each
+// direction at the first page that is elsewhere or cannot be read in.
+static void swap_read_around(struct spt_entry * spte, int slot) {
+    uint8_t * upage = spte->key.addr;
+    int i;
+    // pagedir_set_page() records the mapping in the frame table as the
+    // current thread's
+    if (spte->trd != thread_current()) {
+        return;
+    }
+    eviction_lock_acquire();
+    for (i = 1; i <= SWAP_READ_AROUND; i++) {
+        if (!swap_read_ahead(spte->trd, upage + i * PGSIZE, slot + i)) {
+            break;
+        }
+    }
+    for (i = 1; i <= SWAP_READ_AROUND && slot - i >= 0; i++) {
+        if (!swap_read_ahead(spte->trd, upage - i * PGSIZE, slot - i)) {
+            break;
+        }
+    }
+    eviction_lock_release();
+}
+
+// Loads the page described by |spte| into a new frame, from its file or from
+// swap, and maps it into the user's address space. If |pin| is true, the
+// frame is pinned before it is mapped. |write| is true if the page is being
+// loaded for a write, which a read-only file page does not allow.
+// Returns false if the page could not be loaded.
+bool spt_entry_load(struct spt_entry *spte, bool write, bool pin) {
+    // If the page is still on its way out, wait until it has been saved to
+    // wherever it is going; evict_cluster() does that under the eviction
+    // lock.
+    eviction_lock_acquire();
+    eviction_lock_release();
+    if (spte->file != NULL && (!write || spte->writable)) {
+        // We were trying to read from an executable file.
+        // We weren't trying to write to a read-only page, and we
+        // successfully loaded that page into memory from file.
+        // TODO(agf): load_page_from_spte() will only work the first
+        // time that an executable page gets loaded.
+        // TODO(agf): Rename load_page_from_spte() to indicate that
+        // it is only for executables.
+        if (load_page_from_spte(spte, pin)) {
+            return true;
+        }
+    }
+    if (spte->swap_page_number != -1) {
+        // Obtain a free page and read the page from swap into it.
+        // Until the page is mapped, the frame cannot be evicted, so there is
+        // no need for the eviction lock. Locking the slot waits for the page
+        // to be written out, if it is still being evicted.
+        int slot = spte->swap_page_number;
+        uint8_t *kpage = palloc_get_page(PAL_USER);
+        swap_slot_lock(slot);
+        swap_read_page(slot, (char *) kpage);
+        swap_slot_unlock(slot);
+        if (pin) {
+            ft_pin(kpage);
+        }
+        // Map it into memory.
+        // pagedir_set_page() updates the frame table entry.
+        // TODO(agf): Make the page read-only if needed
+        ASSERT(spte->trd->pagedir != NULL);
+        bool result = pagedir_set_page(spte->trd->pagedir,
+                                       spte->key.addr, kpage, true);
+        ASSERT(result);
+        // Keep the swap slot: as long as the page stays clean, the copy in
+        // swap is up to date and the page need not be written out again.
+        swap_read_around(spte, slot);
+        return true;
+    }
+    return false;
+}
+
+// What fork_page() needs to know while spt_fork() copies an address space
+struct spt_fork_state {
+    struct thread * parent;
+    bool success;
+};
+
+// Maps the page of the parent at |upage|, held in the frame at |kpage|, into
+// the forked child, the current thread, at the same address, copy-on-write:
+// read-only in both processes, until one of them writes to it and gets its
+// own copy from spt_break_cow(). |aux| is the spt_fork_state.
+static void fork_page(void * upage, void * kpage, void * aux) {
+    struct spt_fork_state * state = aux;
+    if (!state->success) {
+        return;
+    }
+    struct spt_entry * spte = spt_entry_lookup(upage, &state->parent->spt);
+    if (spte != NULL && spte->mmapid != 0) {
+        // File mappings are not inherited
+        return;
+    }
+    uint32_t * pagedir = thread_current()->pagedir;
+    pagedir_set_writable(state->parent->pagedir, upage, false);
+    if (!pagedir_set_page(pagedir, upage, kpage, false)) {
+        state->success = false;
+        return;
+    }
+    // The page may differ from its file, and in that case it must not be
+    // dropped on eviction, even once the parent is gone
+    if (pagedir_is_dirty(state->parent->pagedir, upage)) {
+        pagedir_set_dirty(pagedir, upage, true);
+    }
+}
+
+// Gives the current thread, a child just forked from |parent|, a copy of
+// the parent's address space, apart from its file mappings. The pages that
+// are resident are shared copy-on-write; a page that is only in swap is
+// copied into a swap slot of the child's own. The child must already have
+// its own page directory and executable.
+// Returns false if memory or swap is short, leaving the child to clean up
+// what has been copied so far as it exits.
+bool spt_fork(struct thread * parent) {
+    struct thread * cur = thread_current();
+    struct spt_fork_state state;
+    state.parent = parent;
+    state.success = true;
+    char * bounce = palloc_get_page(0);
+    if (bounce == NULL) {
+        return false;
+    }
+
+    // The eviction lock keeps the parent's pages where they are, and makes
+    // the page faults that share or copy them wait until we are done
+    eviction_lock_acquire();
+    struct hash_iterator i;
+    hash_first(&i, &parent->spt);
+    while (hash_next(&i)) {
+        struct spt_entry * pspte = hash_entry(hash_cur(&i), struct spt_entry,
+                                              hash_elem);
+        if (pspte->mmapid != 0) {
+            continue;
+        }
+        ASSERT(pspte->file == NULL || pspte->file == parent->executable);
+        struct spt_entry * spte = spt_entry_allocate(pspte->key.addr, cur);
+        spte->file = pspte->file != NULL ? cur->executable : NULL;
+        spte->file_ofs = pspte->file_ofs;
+        spte->file_read_bytes = pspte->file_read_bytes;
+        spte->writable = pspte->writable;
+        if (pspte->swap_page_number != -1 &&
+            pagedir_get_page(parent->pagedir, pspte->key.addr) == NULL) {
+            int slot = swap_alloc(1);
+            if (slot == -1) {
+                state.success = false;
+                break;
+            }
+            swap_slot_lock(pspte->swap_page_number);
+            swap_read_page(pspte->swap_page_number, bounce);
+            swap_slot_unlock(pspte->swap_page_number);
+            swap_write_page(slot, bounce);
+            swap_slot_unlock(slot);
+            spte->swap_page_number = slot;
+        }
+    }
+    if (state.success) {
+        pagedir_for_each(parent->pagedir, fork_page, &state);
+    }
+    eviction_lock_release();
+    palloc_free_page(bounce);
+    return state.success;
+}
+
+// Gives the current process a page at |upage| that it may write to, where
+// it maps a page read-only because of a fork(). If no other process maps the
+// frame any more, the mapping is just made writable; otherwise the process
+// gets a copy of the page in a frame of its own. If |pin| is true, the
+// frame is pinned.
+// Returns false, having done nothing, if the page is not resident, for
+// instance because it was evicted while a frame for the copy was found.
+bool spt_break_cow(void * upage, bool pin) {
+    uint32_t * pagedir = thread_current()->pagedir;
+    uint8_t * copy = NULL;
+    ASSERT(pg_round_down(upage) == upage);
+    for (;;) {
+        eviction_lock_acquire();
+        void * kpage = pagedir_get_page(pagedir, upage);
+        if (kpage == NULL || !ft_is_cow(kpage)) {
+            if (kpage != NULL) {
+                pagedir_set_writable(pagedir, upage, true);
+                if (pin) {
+                    ft_pin(kpage);
+                }
+            }
+            eviction_lock_release();
+            if (copy != NULL) {
+                palloc_free_page(copy);
+            }
+            return kpage != NULL;
+        }
+        if (copy != NULL) {
+            memcpy(copy, kpage, PGSIZE);
+            ft_remove_user_mapping(kpage, upage);
+            pagedir_clear_page(pagedir, upage);
+            if (pin) {
+                ft_pin(copy);
+            }
+            bool result = pagedir_set_page(pagedir, upage, copy, true);
+            ASSERT(result);
+            pagedir_set_dirty(pagedir, upage, true);
+            eviction_lock_release();
+            return true;
+        }
+        // Allocating may evict, so it cannot be done with the eviction lock
+        // held; look at the page again once the copy has a frame
+        eviction_lock_release();
+        copy = palloc_get_page(PAL_USER);
+    }
+}
+
+// Frees an spt_entry, and the swap slot holding its page, if any.
+static void spt_entry_destroy(struct hash_elem *e, void *aux UNUSED) {
+    struct spt_entry *spte = hash_entry(e, struct spt_entry, hash_elem);
+    if (spte->swap_page_number != -1) {
+        swap_free(spte->swap_page_number, 1);
+    }
+    free(spte);
+}
+
+// Destroys a supplemental page table, freeing its entries and their swap
+// slots. The owning process's pages must no longer be mapped, so that
+// eviction cannot pick them.
+void spt_destroy(struct hash *spt) {
+    hash_destroy(spt, spt_entry_destroy);
+}
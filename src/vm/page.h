@@ -42,8 +42,11 @@ struct spt_entry {
     // ID for mmap and munmap
     mapid_t mmapid;
 
-    // TODO(agf): If the data is stored in swap, then we need info about that
-    // Fields used for loading from swap files
+    // Swap slot holding a copy of the page, or -1. The slot is kept when the
+    // page is loaded back in, so that the page can be evicted again without
+    // being written if it has stayed clean. While |file| is set, the page
+    // comes from the file instead: from an executable, if |mmapid| is 0, or
+    // else from a file mapping, to which it is written back when dirty.
     int swap_page_number;
 
     struct thread * trd;
@@ -64,4 +67,12 @@ struct spt_entry * spt_entry_get_or_create(void *, struct thread *);
 
 struct spt_entry * spt_entry_lookup(void *, struct hash *);
 
+bool spt_entry_load(struct spt_entry *, bool write, bool pin);
+
+void spt_destroy(struct hash *spt);
+
+bool spt_fork(struct thread *parent);
+
+bool spt_break_cow(void *, bool pin);
+
 #endif  // vm/page.h
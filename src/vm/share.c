@@ -0,0 +1,136 @@
+#include "vm/share.h"
+#include <string.h>
+#include "filesys/file.h"
+#include "userprog/pagedir.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+// The shared page cache. Read-only pages of executables are loaded into
+// frames that every process running the same executable maps, instead of
+// each process reading the page into a frame of its own. The cache is keyed
+// by the executable's inode and the page's offset and length in it, and its
+// entries are the frame table entries of the shared frames. A frame leaves
+// the cache when it is evicted or when its last mapping goes away.
+// Protected by the eviction lock.
+static struct hash share_cache;
+
+// Returns a hash value for the key of shared frame |e|.
+static unsigned share_hash(const struct hash_elem *e, void *aux UNUSED) {
+    const struct ft_entry *fte = hash_entry(e, struct ft_entry, share_elem);
+    uintptr_t key[3] = {(uintptr_t) fte->inode, fte->file_ofs,
+                        fte->file_read_bytes};
+    return hash_bytes(key, sizeof key);
+}
+
+// Returns true if the key of shared frame |a| precedes that of |b|.
+static bool share_less(const struct hash_elem *a_, const struct hash_elem *b_,
+                       void *aux UNUSED) {
+    const struct ft_entry *a = hash_entry(a_, struct ft_entry, share_elem);
+    const struct ft_entry *b = hash_entry(b_, struct ft_entry, share_elem);
+    if (a->inode != b->inode) {
+        return a->inode < b->inode;
+    }
+    if (a->file_ofs != b->file_ofs) {
+        return a->file_ofs < b->file_ofs;
+    }
+    return a->file_read_bytes < b->file_read_bytes;
+}
+
+void share_init(void) {
+    hash_init(&share_cache, share_hash, share_less, NULL);
+}
+
+// Returns the shared frame holding the page that |spte| describes, or NULL
+// if there is none.
+static struct ft_entry * share_lookup(const struct spt_entry *spte) {
+    struct ft_entry key;
+    key.inode = file_get_inode(spte->file);
+    key.file_ofs = spte->file_ofs;
+    key.file_read_bytes = spte->file_read_bytes;
+    struct hash_elem *e = hash_find(&share_cache, &key.share_elem);
+    return e != NULL ? hash_entry(e, struct ft_entry, share_elem) : NULL;
+}
+
+// Reads the page that |spte| describes into a new frame, which nobody else
+// can see yet. Returns its kernel virtual address, or NULL on failure.
+static void * read_page(const struct spt_entry *spte) {
+    uint8_t *kpage = palloc_get_page(PAL_USER);
+    if (kpage == NULL) {
+        return NULL;
+    }
+    if (file_read_at(spte->file, kpage, spte->file_read_bytes,
+                     spte->file_ofs) != (int) spte->file_read_bytes) {
+        palloc_free_page(kpage);
+        return NULL;
+    }
+    memset(kpage + spte->file_read_bytes, 0, PGSIZE - spte->file_read_bytes);
+    return kpage;
+}
+
+// Maps the read-only executable page described by |spte| into the current
+// process, from the shared page cache if another process already has it
+// in memory, or else from the file, adding it to the cache. If |pin| is
+// true, the frame is pinned before it is mapped.
+// Returns false if the page could not be loaded.
+bool share_load_page(struct spt_entry *spte, bool pin) {
+    ASSERT(spte->file != NULL && !spte->writable && spte->mmapid == 0);
+    eviction_lock_acquire();
+    struct ft_entry *fte = share_lookup(spte);
+    if (fte == NULL) {
+        // Reading the page may have to evict, and takes a while, so do it
+        // without the eviction lock.
+        eviction_lock_release();
+        void *kpage = read_page(spte);
+        if (kpage == NULL) {
+            return false;
+        }
+        eviction_lock_acquire();
+        // Another process may have loaded the same page in the meantime
+        fte = share_lookup(spte);
+        if (fte != NULL) {
+            palloc_free_page(kpage);
+        } else {
+            fte = ft_lookup(kpage);
+            ASSERT(list_empty(&fte->mappers));
+            fte->shared = true;
+            fte->inode = file_get_inode(spte->file);
+            fte->file_ofs = spte->file_ofs;
+            fte->file_read_bytes = spte->file_read_bytes;
+            hash_insert(&share_cache, &fte->share_elem);
+        }
+    }
+
+    void *kpage = fte->kernel_vaddr;
+    if (pin) {
+        ft_pin(kpage);
+    }
+    // pagedir_set_page() adds the mapping to the frame's mappers
+    bool success = pagedir_set_page(thread_current()->pagedir,
+                                    spte->key.addr, kpage, false);
+    if (!success) {
+        if (pin) {
+            ft_unpin(kpage);
+        }
+        if (list_empty(&fte->mappers)) {
+            share_remove(fte);
+        } else {
+            kpage = NULL;
+        }
+    }
+    eviction_lock_release();
+    if (!success && kpage != NULL) {
+        palloc_free_page(kpage);
+    }
+    return success;
+}
+
+// Takes shared frame |fte|, which must no longer have any mappings, out of
+// the shared page cache. It becomes an ordinary frame again.
+void share_remove(struct ft_entry *fte) {
+    ASSERT(eviction_lock_held());
+    ASSERT(fte->shared && list_empty(&fte->mappers));
+    hash_delete(&share_cache, &fte->share_elem);
+    fte->shared = false;
+    fte->inode = NULL;
+}
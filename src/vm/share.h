@@ -0,0 +1,14 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <stdbool.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+
+void share_init(void);
+
+bool share_load_page(struct spt_entry *, bool pin);
+
+void share_remove(struct ft_entry *);
+
+#endif  // vm/share.h
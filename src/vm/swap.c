@@ -1,26 +1,38 @@
 #include "vm/swap.h"
+#include <bitmap.h>
 #include "vm/page.h"
 #include "devices/block.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
-#include "userprog/syscall.h"
+#include "threads/synch.h"
 #include <stdio.h>
 
 
 static struct block * swap_block;
 static int sectors_needed_for_a_page;
 static int num_swap_pages;
-static struct swapt_entry * swapt;
 
-static struct lock swap_block_lock;
+// One bit per swap slot, set if the slot is in use.
+static struct bitmap * swap_map;
 
-static void swap_lock_acquire(void) {
-    lock_acquire(&swap_block_lock);
-}
+// Where the next search for free slots starts. Allocation is next-fit: the
+// hint moves past each allocation, so that pages evicted one after another
+// land in adjacent slots and can be read back with little seeking, and a
+// search only goes back to the start of swap when it reaches the end.
+static size_t swap_hint;
 
-static void swap_lock_release(void) {
-    lock_release(&swap_block_lock);
-}
+// One bit per swap slot, set while the slot is locked: from when it is
+// allocated until the page has been written to it, and while a page is being
+// read back from it. There is no lock on the swap device as a whole; the
+// block driver serializes the sector transfers themselves, so I/O on
+// different slots can overlap.
+static struct bitmap * swap_busy;
+
+// Protects swap_map, swap_hint and swap_busy.
+static struct lock swap_map_lock;
+
+// Signalled whenever a slot is unlocked.
+static struct condition swap_unlocked;
 
 void swap_init(void) {
     swap_block = block_get_role(BLOCK_SWAP);
@@ -29,25 +41,23 @@ void swap_init(void) {
         sectors_needed_for_a_page++;
     }
     num_swap_pages = block_size(swap_block) / sectors_needed_for_a_page;
-    swapt = malloc(num_swap_pages * sizeof(struct swapt_entry));
-    int i;
-    for (i = 0; i < num_swap_pages; i++) {
-        swapt[i].uaddr = NULL;
+    swap_map = bitmap_create(num_swap_pages);
+    swap_busy = bitmap_create(num_swap_pages);
+    if (swap_map == NULL || swap_busy == NULL) {
+        PANIC("swap: cannot allocate slot bitmap");
     }
-    lock_init(&swap_block_lock);
+    swap_hint = 0;
+    lock_init(&swap_map_lock);
+    cond_init(&swap_unlocked);
 }
 
 // Write a page from buffer into swap.
-// buffer must be page-aligned.
+// buffer must be page-aligned, and the slot locked.
 void swap_write_page(int swap_page_number, const char *buffer) {
-    swap_lock_acquire();
-    bool already_held = filesys_lock_held();
-    ASSERT(!already_held);
-    if (!already_held) {
-        filesys_lock_acquire();
-    }
+    ASSERT(swap_page_number >= 0);
     ASSERT(swap_page_number < num_swap_pages);
     ASSERT(pg_round_down(buffer) == buffer);
+    ASSERT(bitmap_test(swap_busy, swap_page_number));
     block_sector_t sector = swap_page_number * sectors_needed_for_a_page;
     int i;
     for (i = 0; i < sectors_needed_for_a_page; i++) {
@@ -55,23 +65,27 @@ void swap_write_page(int swap_page_number, const char *buffer) {
         sector++;
         buffer += BLOCK_SECTOR_SIZE;
     }
-    if (!already_held) {
-        filesys_lock_release();
+}
+
+// Write |cnt| pages into swap, page |pages[i]| to slot |slots[i]|.
+// The pages are written back to back, so that a cluster of pages that were
+// given adjacent slots goes out as a sequential run of sectors. Each slot is
+// unlocked as soon as its page is written.
+void swap_write_pages(const int *slots, void * const *pages, size_t cnt) {
+    size_t i;
+    for (i = 0; i < cnt; i++) {
+        swap_write_page(slots[i], pages[i]);
+        swap_slot_unlock(slots[i]);
     }
-    swap_lock_release();
 }
 
 // Read a page from swap into buffer.
-// Buffer is rounded down to the nearest page boundary.
+// Buffer is rounded down to the nearest page boundary, and the slot must be
+// locked.
 void swap_read_page(int swap_page_number, char *buffer) {
-    swap_lock_acquire();
-    bool already_held = filesys_lock_held();
-    ASSERT(!already_held);
-    if (!already_held) {
-        filesys_lock_acquire();
-    }
     ASSERT(swap_page_number >= 0);
     ASSERT(swap_page_number < num_swap_pages);
+    ASSERT(bitmap_test(swap_busy, swap_page_number));
     buffer = pg_round_down(buffer);
     block_sector_t sector = swap_page_number * sectors_needed_for_a_page;
     int i;
@@ -81,44 +95,60 @@ void swap_read_page(int swap_page_number, char *buffer) {
         sector++;
         buffer += BLOCK_SECTOR_SIZE;
     }
-    if (!already_held) {
-        filesys_lock_release();
-    }
-    swap_lock_release();
 }
 
-// Returns a free swap slot number, or -1 if there are no free slots
-int swap_find_free_slot(void) {
-    int i;
-    for (i = 0; i < num_swap_pages; i++) {
-        if (swapt[i].uaddr == NULL) {
-            return i;
+// Allocates |cnt| adjacent swap slots and returns the number of the first,
+// or -1 if there is no such run of free slots.
+// The slots come locked, since they do not hold a page yet; writing pages to
+// them with swap_write_pages() unlocks them.
+int swap_alloc(size_t cnt) {
+    lock_acquire(&swap_map_lock);
+    size_t slot = bitmap_scan_and_flip(swap_map, swap_hint, cnt, false);
+    if (slot == BITMAP_ERROR && swap_hint != 0) {
+        slot = bitmap_scan_and_flip(swap_map, 0, cnt, false);
+    }
+    if (slot != BITMAP_ERROR) {
+        ASSERT(bitmap_none(swap_busy, slot, cnt));
+        bitmap_set_multiple(swap_busy, slot, cnt, true);
+        swap_hint = slot + cnt;
+        if (swap_hint >= bitmap_size(swap_map)) {
+            swap_hint = 0;
         }
     }
-    return -1;
+    lock_release(&swap_map_lock);
+    return slot != BITMAP_ERROR ? (int) slot : -1;
 }
 
-void mark_slot_unused(int swap_num) {
-    swapt[swap_num].uaddr = NULL;
+// Frees |cnt| swap slots starting at |slot|.
+void swap_free(int slot, size_t cnt) {
+    ASSERT(slot >= 0 && slot + cnt <= (size_t) num_swap_pages);
+    lock_acquire(&swap_map_lock);
+    ASSERT(bitmap_all(swap_map, slot, cnt));
+    ASSERT(bitmap_none(swap_busy, slot, cnt));
+    bitmap_set_multiple(swap_map, slot, cnt, false);
+    lock_release(&swap_map_lock);
 }
 
-// TODO(agf): Might need a synchronized function that finds a free slot and
-// writes to it
-
-// Write a frame table entry to an empty swap slot, and return the number of
-// the swap slot.
-// If there are no free swap slots, then do not perform any writing, and return
-// -1.
-int swap_dump_ft_entry(struct ft_entry * f) {
-    ASSERT(f->user_vaddr != NULL);
-    ASSERT(f->trd != NULL);
-    int swap_slot = swap_find_free_slot();
-    if (swap_slot == -1) {
-        return swap_slot;
+// Locks swap slot |slot|, waiting for any I/O on it to finish first. Locking
+// the slot of a page that is being evicted thus waits until the page has
+// been written out.
+void swap_slot_lock(int slot) {
+    ASSERT(slot >= 0 && slot < num_swap_pages);
+    lock_acquire(&swap_map_lock);
+    ASSERT(bitmap_test(swap_map, slot));
+    while (bitmap_test(swap_busy, slot)) {
+        cond_wait(&swap_unlocked, &swap_map_lock);
     }
-    // There were problems with swap_write_page(swap_slot, f->user_vaddr)
-    swap_write_page(swap_slot, f->kernel_vaddr);
-    swapt[swap_slot].kaddr = f->kernel_vaddr;
-    swapt[swap_slot].uaddr = f->user_vaddr;
-    return swap_slot;
+    bitmap_mark(swap_busy, slot);
+    lock_release(&swap_map_lock);
+}
+
+// Unlocks swap slot |slot|.
+void swap_slot_unlock(int slot) {
+    ASSERT(slot >= 0 && slot < num_swap_pages);
+    lock_acquire(&swap_map_lock);
+    ASSERT(bitmap_test(swap_busy, slot));
+    bitmap_reset(swap_busy, slot);
+    cond_broadcast(&swap_unlocked, &swap_map_lock);
+    lock_release(&swap_map_lock);
 }
@@ -1,25 +1,22 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
-#include "vm/frame.h"
+#include <stddef.h>
 
 void swap_init(void);
 
-struct swapt_entry {
-    // Kernel virtual address
-    void * kaddr;
-    // User virtual address
-    void * uaddr;
-};
-
 void swap_write_page(int, const char *);
 
+void swap_write_pages(const int *, void * const *, size_t);
+
 void swap_read_page(int, char *);
 
-int swap_find_free_slot(void);
+int swap_alloc(size_t);
+
+void swap_free(int, size_t);
 
-void mark_slot_unused(int);
+void swap_slot_lock(int);
 
-int swap_dump_ft_entry(struct ft_entry *);
+void swap_slot_unlock(int);
 
 #endif  // vm/swap.h